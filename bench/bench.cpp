@@ -0,0 +1,292 @@
+// OTA 热路径基准测试。
+// 合成镜像大小由环境变量 OTA_BENCH_IMAGE_MIB 指定 (默认 32), 临时文件放在 $TMPDIR 下。
+// 未指定 --benchmark_out 时结果写入 bench_results.json, 便于版本间比对。
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "block_writer.h"
+#include "crc32c.h"
+#include "dedup.h"
+#include "delta.h"
+#include "fastcdc.h"
+#include "file_io.h"
+#include "lz4_block.h"
+#include "pipeline.h"
+#include "sha256.h"
+#include "verify.h"
+
+namespace {
+
+uint64_t image_bytes() {
+    const char* env = std::getenv("OTA_BENCH_IMAGE_MIB");
+    const uint64_t mib = env ? std::strtoull(env, nullptr, 10) : 32;
+    return (mib > 0 ? mib : 32) << 20;
+}
+
+// 可复现的合成数据: 按 4 KiB 页混合随机数据, 文本样式数据与零页, 接近真实镜像的可压缩性
+std::vector<uint8_t> synthetic(size_t size, uint64_t seed) {
+    std::vector<uint8_t> out(size);
+    uint64_t x = seed * 0x9E3779B97F4A7C15ull + 1;
+    auto next = [&x] {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        return x;
+    };
+    static const char text[] = "ota update payload block header checksum partition ";
+    for (size_t page = 0; page < size; page += 4096) {
+        const size_t end = page + 4096 < size ? page + 4096 : size;
+        const uint64_t kind = next() % 10;
+        for (size_t i = page; i < end; ++i) {
+            if (kind < 3) {
+                out[i] = uint8_t(next());
+            } else if (kind < 7) {
+                out[i] = uint8_t(text[(i + kind) % (sizeof(text) - 1)]);
+            } else {
+                out[i] = 0;
+            }
+        }
+    }
+    return out;
+}
+
+void write_file(const std::string& path, const std::vector<uint8_t>& data) {
+    ota::FileDescriptor fd(path, O_WRONLY | O_CREAT | O_TRUNC);
+    fd.write_full(data.data(), data.size());
+}
+
+// 宏基准共用的磁盘文件, 首次使用时生成, 进程退出时清理
+class Fixture {
+public:
+    static Fixture& get() {
+        static Fixture f;
+        return f;
+    }
+
+    const std::string& base() { return base_; }
+    const std::string& target() { return target_; }
+    std::string path(const std::string& name) { return dir_ + "/" + name; }
+    uint64_t size() const { return size_; }
+
+    const std::string& patch() {
+        if (patch_.empty()) {
+            patch_ = path("new.delta");
+            ota::delta_diff(base_, target_, patch_);
+        }
+        return patch_;
+    }
+
+    const std::string& payload() {
+        if (payload_.empty()) {
+            payload_ = path("new.lz");
+            ota::compress_file(target_, payload_, ota::PipelineOptions());
+        }
+        return payload_;
+    }
+
+    ~Fixture() {
+        for (const char* name : {"base.img", "new.img", "new.delta", "new.lz", "out.img",
+                                 "store/chunks.pack", "store/chunks.idx"}) {
+            ::unlink(path(name).c_str());
+        }
+        ::rmdir(path("store").c_str());
+        ::rmdir(dir_.c_str());
+    }
+
+private:
+    Fixture() : size_(image_bytes()) {
+        const char* tmp = std::getenv("TMPDIR");
+        std::string tmpl = std::string(tmp ? tmp : "/tmp") + "/ota_bench.XXXXXX";
+        std::vector<char> buf(tmpl.begin(), tmpl.end());
+        buf.push_back('\0');
+        if (!::mkdtemp(buf.data())) throw ota::io_error("cannot create", tmpl);
+        dir_ = buf.data();
+
+        std::vector<uint8_t> data = synthetic(size_t(size_), 1);
+        base_ = path("base.img");
+        write_file(base_, data);
+        // 新镜像: 每 1 MiB 改动 64 字节, 模拟一次小版本升级
+        for (size_t off = 4096; off + 64 < data.size(); off += 1u << 20) {
+            for (size_t i = 0; i < 64; ++i) data[off + i] ^= 0x5A;
+        }
+        target_ = path("new.img");
+        write_file(target_, data);
+    }
+
+    uint64_t size_;
+    std::string dir_;
+    std::string base_;
+    std::string target_;
+    std::string patch_;
+    std::string payload_;
+};
+
+// ---- 微基准: 内存中的单一内核 ----
+
+void BM_Sha256(benchmark::State& state) {
+    const std::vector<uint8_t> data = synthetic(size_t(state.range(0)), 2);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ota::Sha256::hash(data.data(), data.size()));
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * state.range(0));
+    state.SetLabel(ota::Sha256::impl_name());
+}
+BENCHMARK(BM_Sha256)->Arg(4 << 10)->Arg(64 << 10)->Arg(1 << 20);
+
+void BM_Crc32c(benchmark::State& state) {
+    const std::vector<uint8_t> data = synthetic(size_t(state.range(0)), 3);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ota::crc32c(0, data.data(), data.size()));
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_Crc32c)->Arg(4 << 10)->Arg(1 << 20);
+
+void BM_FastCdc(benchmark::State& state) {
+    const std::vector<uint8_t> data = synthetic(8u << 20, 4);
+    ota::CdcParams params;
+    params.avg_size = size_t(state.range(0));
+    params.min_size = params.avg_size / 4;
+    params.max_size = params.avg_size * 4;
+    const ota::FastCdc cdc(params);
+    for (auto _ : state) {
+        size_t chunks = 0;
+        for (size_t pos = 0; pos < data.size(); ++chunks) {
+            pos += cdc.next_cut(data.data() + pos, data.size() - pos);
+        }
+        benchmark::DoNotOptimize(chunks);
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(data.size()));
+}
+BENCHMARK(BM_FastCdc)->Arg(16 << 10)->Arg(64 << 10);
+
+void BM_Lz4Compress(benchmark::State& state) {
+    const std::vector<uint8_t> data = synthetic(1u << 20, 5);
+    std::vector<uint8_t> out(data.size());
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ota::lz4_compress(data.data(), data.size(), out.data(), out.size()));
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(data.size()));
+}
+BENCHMARK(BM_Lz4Compress);
+
+void BM_Lz4Decompress(benchmark::State& state) {
+    const std::vector<uint8_t> data = synthetic(1u << 20, 5);
+    std::vector<uint8_t> packed(data.size());
+    const size_t n = ota::lz4_compress(data.data(), data.size(), packed.data(), packed.size());
+    if (n == 0) {
+        state.SkipWithError("synthetic data did not compress");
+        return;
+    }
+    std::vector<uint8_t> out(data.size());
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ota::lz4_decompress(packed.data(), n, out.data(), out.size()));
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(data.size()));
+}
+BENCHMARK(BM_Lz4Decompress);
+
+// ---- 宏基准: 端到端命令路径 (含文件 I/O) ----
+
+void BM_HashImage(benchmark::State& state) {
+    Fixture& f = Fixture::get();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ota::hash_image(f.target()));
+    }
+    state.SetBytesProcessed(int64_t(state.iterations() * f.size()));
+}
+BENCHMARK(BM_HashImage)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// 内核是否支持 io_uring (容器或 seccomp 可能禁用), 只探测一次
+bool uring_available() {
+    static const bool ok = [] {
+        ota::BlockWriter probe(Fixture::get().path("out.img"), ota::WriterOptions());
+        return std::strcmp(probe.backend_name(), "io_uring") == 0;
+    }();
+    return ok;
+}
+
+// 参数: 0 = pwrite, 1 = io_uring
+void BM_DeltaApply(benchmark::State& state) {
+    if (state.range(0) && !uring_available()) {
+        state.SkipWithError("io_uring unavailable");
+        return;
+    }
+    Fixture& f = Fixture::get();
+    const std::string& patch = f.patch();
+    ota::DeltaApplyOptions opts;
+    opts.writer.backend = state.range(0) ? ota::WriterOptions::Backend::Uring
+                                         : ota::WriterOptions::Backend::Pwrite;
+    opts.writer.fsync_interval = 0;
+    for (auto _ : state) {
+        ota::delta_apply(f.base(), patch, f.path("out.img"), opts);
+    }
+    state.SetBytesProcessed(int64_t(state.iterations() * f.size()));
+    state.SetLabel(state.range(0) ? "io_uring" : "pwrite");
+}
+BENCHMARK(BM_DeltaApply)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// 参数: 解压线程数
+void BM_Decompress(benchmark::State& state) {
+    Fixture& f = Fixture::get();
+    const std::string& payload = f.payload();
+    ota::PipelineOptions opts;
+    opts.threads = unsigned(state.range(0));
+    opts.writer.fsync_interval = 0;
+    for (auto _ : state) {
+        ota::decompress_file(payload, f.path("out.img"), opts);
+    }
+    state.SetBytesProcessed(int64_t(state.iterations() * f.size()));
+}
+BENCHMARK(BM_Decompress)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+void BM_StoreImage(benchmark::State& state) {
+    Fixture& f = Fixture::get();
+    const std::string store = f.path("store");
+    for (auto _ : state) {
+        state.PauseTiming();
+        ::unlink((store + "/chunks.pack").c_str());
+        ::unlink((store + "/chunks.idx").c_str());
+        state.ResumeTiming();
+        ota::store_image(f.target(), store, f.path("out.img"), ota::CdcParams());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations() * f.size()));
+}
+BENCHMARK(BM_StoreImage)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::vector<char*> args(argv, argv + argc);
+    bool has_out = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strncmp(argv[i], "--benchmark_out=", 16) == 0) has_out = true;
+    }
+    static char out_arg[] = "--benchmark_out=bench_results.json";
+    static char fmt_arg[] = "--benchmark_out_format=json";
+    if (!has_out) {
+        args.push_back(out_arg);
+        args.push_back(fmt_arg);
+    }
+    int n = int(args.size());
+    args.push_back(nullptr);
+
+    benchmark::Initialize(&n, args.data());
+    if (benchmark::ReportUnrecognizedArguments(n, args.data())) return 1;
+    benchmark::AddCustomContext("sha256_impl", ota::Sha256::impl_name());
+    benchmark::AddCustomContext("image_bytes", std::to_string(image_bytes()));
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace ota {
+
+// 带上限的线性分配器: 一次预留 capacity 字节, 按需切分, 整体释放。
+// 预留区未被触碰的部分不会占用物理内存。
+class Arena {
+public:
+    explicit Arena(size_t capacity)
+        : capacity_(capacity), base_(new uint8_t[capacity]), used_(0), peak_(0) {}
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // align 须为 2 的幂, 按实际地址对齐 (O_DIRECT 缓冲区需要 4 KiB 对齐)
+    void* allocate(size_t size, size_t align = 64) {
+        const uintptr_t base = reinterpret_cast<uintptr_t>(base_.get());
+        const size_t start = size_t(((base + used_ + align - 1) & ~uintptr_t(align - 1)) - base);
+        if (start > capacity_ || size > capacity_ - start) {
+            throw std::runtime_error("memory limit exceeded: need " + std::to_string(start + size) +
+                                     " bytes, limit " + std::to_string(capacity_));
+        }
+        used_ = start + size;
+        if (used_ > peak_) peak_ = used_;
+        return base_.get() + start;
+    }
+
+    template <typename T>
+    T* allocate_array(size_t count) {
+        return static_cast<T*>(allocate(count * sizeof(T), alignof(T) > 64 ? alignof(T) : 64));
+    }
+
+    // 整体释放, 峰值从此重新统计; 已触碰的页保留, 复用时不再缺页
+    void reset() { used_ = peak_ = 0; }
+
+    size_t capacity() const { return capacity_; }
+    size_t used() const { return used_; }
+    size_t peak() const { return peak_; }
+
+private:
+    size_t capacity_;
+    std::unique_ptr<uint8_t[]> base_;
+    size_t used_;
+    size_t peak_;
+};
+
+} // namespace ota
@@ -0,0 +1,173 @@
+#include "base_cache.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+
+#include "file_io.h"
+#include "pipeline.h"
+#include "trace.h"
+
+namespace ota {
+
+namespace {
+
+std::runtime_error corrupt(const std::string& path, const std::string& why) {
+    return std::runtime_error("corrupt payload " + path + ": " + why);
+}
+
+} // namespace
+
+bool CompressedImage::detect(const std::string& path) {
+    FileDescriptor fd(path, O_RDONLY);
+    uint8_t magic[8];
+    return fd.read_full(magic, sizeof(magic)) == sizeof(magic) &&
+           std::memcmp(magic, kFrameMagic, 8) == 0;
+}
+
+CompressedImage::CompressedImage(const std::string& path) : file_(path) {
+    const uint8_t* p = file_.data();
+    const uint64_t size = file_.size();
+    if (size < kFrameHeaderSize) throw corrupt(path, "bad frame header");
+    if (const char* why = parse_frame_header(p, &chunk_size_)) throw corrupt(path, why);
+
+    // 只读块头, 跳过数据
+    uint64_t off = kFrameHeaderSize;
+    bool short_chunk = false;
+    for (;;) {
+        if (size - off < kChunkHeaderSize) throw corrupt(path, "truncated");
+        ChunkHeader h;
+        if (const char* why = parse_chunk_header(p + off, chunk_size_, &h)) throw corrupt(path, why);
+        if (h.raw_len == 0) break;
+        if (short_chunk) throw corrupt(path, "short chunk before the last one");
+        short_chunk = h.raw_len != chunk_size_;
+        if (size - off - kChunkHeaderSize < h.payload_len) throw corrupt(path, "truncated");
+        offsets_.push_back(off);
+        raw_size_ += h.raw_len;
+        off += kChunkHeaderSize + h.payload_len;
+    }
+}
+
+size_t CompressedImage::decode(uint64_t chunk, uint8_t* dst) const {
+    const uint8_t* hdr = file_.data() + offsets_[chunk];
+    ChunkHeader h;
+    parse_chunk_header(hdr, chunk_size_, &h);  // 打开时已校验
+    TraceSpan span(Stage::Decompress, h.raw_len);
+    if (!decode_chunk(h, hdr + kChunkHeaderSize, dst)) {
+        throw corrupt(path(), "chunk " + std::to_string(chunk) + " does not decode");
+    }
+    return h.raw_len;
+}
+
+BlockCache::BlockCache(size_t block_size, size_t capacity_blocks)
+    : pool_(capacity_blocks, block_size) {
+    if (capacity_blocks == 0) throw std::invalid_argument("block cache capacity must be non-zero");
+}
+
+uint8_t* BlockCache::take_buffer() {
+    uint8_t* buf = nullptr;
+    if (pool_.try_acquire(buf)) return buf;
+    // 从最久未用的一端找未被引用的块淘汰
+    for (auto it = lru_.rbegin(); it != lru_.rend(); ++it) {
+        auto e = entries_.find(*it);
+        if (e->second.refs == 0 && e->second.state == State::Ready) {
+            buf = e->second.data;
+            lru_.erase(e->second.lru);
+            entries_.erase(e);
+            ++stats_.evictions;
+            return buf;
+        }
+    }
+    return nullptr;
+}
+
+const uint8_t* BlockCache::pin(const CompressedImage& image, uint32_t image_id, uint64_t block,
+                               size_t* len) {
+    if (image.chunk_size() > pool_.buffer_size()) {
+        throw std::invalid_argument("chunk size of " + image.path() + " exceeds cache block size");
+    }
+    const uint64_t k = key(image_id, block);
+    std::unique_lock<std::mutex> lock(mu_);
+    bool waited = false;
+    uint8_t* buf = nullptr;
+    for (;;) {
+        auto it = entries_.find(k);
+        if (it != entries_.end()) {
+            Entry& e = it->second;
+            if (e.state == State::Loading) {
+                if (!waited) ++stats_.waits;
+                waited = true;
+                cv_.wait(lock);
+                continue;
+            }
+            ++e.refs;
+            lru_.splice(lru_.begin(), lru_, e.lru);
+            if (!waited) ++stats_.hits;
+            *len = e.len;
+            return e.data;
+        }
+        if ((buf = take_buffer()) != nullptr) break;
+        cv_.wait(lock);  // 缓冲区全部被引用, 等待释放
+    }
+
+    Entry& e = entries_[k];
+    e.data = buf;
+    e.refs = 1;
+    lru_.push_front(k);
+    e.lru = lru_.begin();
+    ++stats_.decoded;
+    lock.unlock();
+
+    // 解码在锁外进行, 其他线程请求同一块时在上面等待
+    size_t n = 0;
+    try {
+        n = image.decode(block, buf);
+    } catch (...) {
+        lock.lock();
+        lru_.erase(entries_[k].lru);
+        entries_.erase(k);
+        pool_.release(buf);
+        cv_.notify_all();
+        throw;
+    }
+
+    lock.lock();
+    Entry& ready = entries_[k];
+    ready.len = n;
+    ready.state = State::Ready;
+    cv_.notify_all();
+    *len = n;
+    return buf;
+}
+
+void BlockCache::unpin(uint32_t image_id, uint64_t block) {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = entries_.find(key(image_id, block));
+    if (it == entries_.end() || it->second.refs == 0) throw std::logic_error("unpin without pin");
+    if (--it->second.refs == 0) cv_.notify_all();
+}
+
+BlockCacheStats BlockCache::stats() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    return stats_;
+}
+
+const uint8_t* CachedBase::view(uint64_t offset, size_t* len) {
+    const uint64_t block = offset / image_.chunk_size();
+    if (!data_ || block != block_) {
+        release();
+        data_ = cache_.pin(image_, image_id_, block, &block_len_);
+        block_ = block;
+    }
+    const size_t skip = size_t(offset - block * image_.chunk_size());
+    *len = block_len_ - skip;
+    return data_ + skip;
+}
+
+void CachedBase::release() {
+    if (data_) cache_.unpin(image_id_, block_);
+    data_ = nullptr;
+}
+
+} // namespace ota
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "buffer_pool.h"
+#include "delta.h"
+#include "mapped_file.h"
+
+namespace ota {
+
+// mmap 的 OTALZ401 压缩镜像, 打开时遍历块头建立索引, 之后可按块随机解码。
+// 除最后一块外各块原始长度须等于帧头中的 chunk_size (compress_file 的输出满足此条件)
+class CompressedImage {
+public:
+    explicit CompressedImage(const std::string& path);
+
+    // 文件是否以 OTALZ401 帧头开始
+    static bool detect(const std::string& path);
+
+    const std::string& path() const { return file_.path(); }
+    uint64_t raw_size() const { return raw_size_; }
+    size_t chunk_size() const { return chunk_size_; }
+    uint64_t chunk_count() const { return offsets_.size(); }
+
+    // 解码第 chunk 块到 dst (至少 chunk_size 字节), 返回原始长度
+    size_t decode(uint64_t chunk, uint8_t* dst) const;
+
+private:
+    MappedFile file_;
+    size_t chunk_size_ = 0;
+    uint64_t raw_size_ = 0;
+    std::vector<uint64_t> offsets_;  // 各块头在文件中的偏移
+};
+
+struct BlockCacheStats {
+    uint64_t hits = 0;
+    uint64_t decoded = 0;    // 实际解码的块数
+    uint64_t waits = 0;      // 等待其他线程解码同一块的次数
+    uint64_t evictions = 0;
+};
+
+// 多个任务共享的解压块 LRU 缓存, 块缓冲区全部来自一个预分配的 BufferPool。
+// 同一块同时被多个线程请求时只解码一次, 其余线程等待结果。
+// 被引用 (pin) 的块不会被淘汰; 缓冲区不足时请求方等待其他线程释放。
+class BlockCache {
+public:
+    BlockCache(size_t block_size, size_t capacity_blocks);
+
+    BlockCache(const BlockCache&) = delete;
+    BlockCache& operator=(const BlockCache&) = delete;
+
+    // 取得 image 的第 block 块并加引用, 长度写入 *len; 用完后调用 unpin
+    const uint8_t* pin(const CompressedImage& image, uint32_t image_id, uint64_t block, size_t* len);
+    void unpin(uint32_t image_id, uint64_t block);
+
+    size_t block_size() const { return pool_.buffer_size(); }
+    size_t capacity() const { return pool_.count(); }
+    BlockCacheStats stats() const;
+
+private:
+    enum class State { Loading, Ready };
+
+    struct Entry {
+        uint8_t* data = nullptr;
+        size_t len = 0;
+        unsigned refs = 0;
+        State state = State::Loading;
+        std::list<uint64_t>::iterator lru;
+    };
+
+    static uint64_t key(uint32_t image_id, uint64_t block) {
+        return (uint64_t(image_id) << 40) | block;
+    }
+    uint8_t* take_buffer();
+
+    BufferPool pool_;
+    mutable std::mutex mu_;
+    std::condition_variable cv_;
+    std::unordered_map<uint64_t, Entry> entries_;
+    std::list<uint64_t> lru_;  // 表头为最近使用
+    BlockCacheStats stats_;
+};
+
+// 经 BlockCache 读取压缩基础镜像, 始终只引用当前所在的一块
+class CachedBase : public BaseReader {
+public:
+    CachedBase(const CompressedImage& image, uint32_t image_id, BlockCache& cache)
+        : image_(image), image_id_(image_id), cache_(cache) {}
+    ~CachedBase() override { release(); }
+
+    CachedBase(const CachedBase&) = delete;
+    CachedBase& operator=(const CachedBase&) = delete;
+
+    uint64_t size() const override { return image_.raw_size(); }
+    const std::string& name() const override { return image_.path(); }
+    const uint8_t* view(uint64_t offset, size_t* len) override;
+
+private:
+    void release();
+
+    const CompressedImage& image_;
+    uint32_t image_id_;
+    BlockCache& cache_;
+    const uint8_t* data_ = nullptr;
+    uint64_t block_ = 0;
+    size_t block_len_ = 0;
+};
+
+} // namespace ota
@@ -0,0 +1,414 @@
+#include "batch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#include <fcntl.h>
+#include <stdlib.h>
+
+#include "arena.h"
+#include "file_io.h"
+#include "mapped_file.h"
+#include "trace.h"
+#include "work_stealing.h"
+
+namespace ota {
+
+namespace {
+
+// 清单用到的 JSON 子集足够小, 自带一个递归下降解析器, 不引入外部依赖
+struct JsonValue {
+    enum class Type { Null, Bool, Number, String, Array, Object };
+
+    Type type = Type::Null;
+    bool boolean = false;
+    double number = 0;
+    std::string str;
+    std::vector<JsonValue> items;
+    std::vector<std::pair<std::string, JsonValue>> fields;
+
+    const JsonValue* get(const std::string& key) const {
+        for (const auto& f : fields) {
+            if (f.first == key) return &f.second;
+        }
+        return nullptr;
+    }
+};
+
+class JsonParser {
+public:
+    JsonParser(const std::string& text, const std::string& path) : text_(text), path_(path) {}
+
+    JsonValue parse() {
+        JsonValue v = value(0);
+        skip_space();
+        if (pos_ != text_.size()) fail("trailing characters");
+        return v;
+    }
+
+private:
+    [[noreturn]] void fail(const std::string& why) const {
+        throw std::runtime_error("invalid batch manifest " + path_ + ": " + why + " at offset " +
+                                 std::to_string(pos_));
+    }
+
+    void skip_space() {
+        while (pos_ < text_.size() && (text_[pos_] == ' ' || text_[pos_] == '\t' ||
+                                       text_[pos_] == '\n' || text_[pos_] == '\r')) {
+            ++pos_;
+        }
+    }
+
+    char peek() {
+        skip_space();
+        if (pos_ == text_.size()) fail("unexpected end");
+        return text_[pos_];
+    }
+
+    void expect(char c) {
+        if (peek() != c) fail(std::string("expected '") + c + "'");
+        ++pos_;
+    }
+
+    bool literal(const char* word) {
+        const size_t n = std::char_traits<char>::length(word);
+        if (text_.compare(pos_, n, word) != 0) return false;
+        pos_ += n;
+        return true;
+    }
+
+    JsonValue value(int depth) {
+        if (depth > 64) fail("nesting too deep");
+        JsonValue v;
+        const char c = peek();
+        if (c == '{') {
+            v.type = JsonValue::Type::Object;
+            ++pos_;
+            if (peek() == '}') {
+                ++pos_;
+                return v;
+            }
+            for (;;) {
+                if (peek() != '"') fail("expected object key");
+                std::string key = string();
+                expect(':');
+                v.fields.emplace_back(std::move(key), value(depth + 1));
+                if (peek() == ',') {
+                    ++pos_;
+                    continue;
+                }
+                expect('}');
+                return v;
+            }
+        }
+        if (c == '[') {
+            v.type = JsonValue::Type::Array;
+            ++pos_;
+            if (peek() == ']') {
+                ++pos_;
+                return v;
+            }
+            for (;;) {
+                v.items.push_back(value(depth + 1));
+                if (peek() == ',') {
+                    ++pos_;
+                    continue;
+                }
+                expect(']');
+                return v;
+            }
+        }
+        if (c == '"') {
+            v.type = JsonValue::Type::String;
+            v.str = string();
+            return v;
+        }
+        if (literal("true")) {
+            v.type = JsonValue::Type::Bool;
+            v.boolean = true;
+            return v;
+        }
+        if (literal("false")) {
+            v.type = JsonValue::Type::Bool;
+            return v;
+        }
+        if (literal("null")) return v;
+
+        const char* begin = text_.c_str() + pos_;
+        char* end = nullptr;
+        errno = 0;
+        v.number = std::strtod(begin, &end);
+        if (end == begin || errno != 0) fail("unexpected character");
+        v.type = JsonValue::Type::Number;
+        pos_ += size_t(end - begin);
+        return v;
+    }
+
+    unsigned hex4() {
+        if (text_.size() - pos_ < 4) fail("truncated \\u escape");
+        unsigned cp = 0;
+        for (int i = 0; i < 4; ++i) {
+            const char h = text_[pos_++];
+            cp <<= 4;
+            if (h >= '0' && h <= '9') cp |= unsigned(h - '0');
+            else if (h >= 'a' && h <= 'f') cp |= unsigned(h - 'a' + 10);
+            else if (h >= 'A' && h <= 'F') cp |= unsigned(h - 'A' + 10);
+            else fail("bad \\u escape");
+        }
+        return cp;
+    }
+
+    void put_utf8(std::string& out, unsigned cp) {
+        if (cp < 0x80) {
+            out += char(cp);
+        } else if (cp < 0x800) {
+            out += char(0xC0 | (cp >> 6));
+            out += char(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            out += char(0xE0 | (cp >> 12));
+            out += char(0x80 | ((cp >> 6) & 0x3F));
+            out += char(0x80 | (cp & 0x3F));
+        } else {
+            out += char(0xF0 | (cp >> 18));
+            out += char(0x80 | ((cp >> 12) & 0x3F));
+            out += char(0x80 | ((cp >> 6) & 0x3F));
+            out += char(0x80 | (cp & 0x3F));
+        }
+    }
+
+    std::string string() {
+        expect('"');
+        std::string out;
+        for (;;) {
+            if (pos_ == text_.size()) fail("unterminated string");
+            const char c = text_[pos_++];
+            if (c == '"') return out;
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (pos_ == text_.size()) fail("unterminated string");
+            const char e = text_[pos_++];
+            switch (e) {
+            case '"': case '\\': case '/': out += e; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                unsigned cp = hex4();
+                // UTF-16 代理对
+                if (cp >= 0xD800 && cp < 0xDC00 && literal("\\u")) {
+                    const unsigned lo = hex4();
+                    if (lo < 0xDC00 || lo >= 0xE000) fail("bad surrogate pair");
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                }
+                put_utf8(out, cp);
+                break;
+            }
+            default: fail("bad escape");
+            }
+        }
+    }
+
+    const std::string& text_;
+    const std::string& path_;
+    size_t pos_ = 0;
+};
+
+std::string read_text(const std::string& path) {
+    FileDescriptor fd(path, O_RDONLY);
+    std::string text;
+    char buf[1 << 16];
+    size_t n;
+    while ((n = fd.read_full(buf, sizeof(buf))) > 0) text.append(buf, n);
+    return text;
+}
+
+std::string resolve(const std::string& dir, const std::string& path) {
+    if (path.empty() || path[0] == '/' || dir.empty()) return path;
+    return dir + "/" + path;
+}
+
+// 同一文件经不同路径写法引用时也视为同一文件; 尚不存在的输出文件按所在目录规范化
+std::string canonical(const std::string& path) {
+    char buf[PATH_MAX];
+    if (::realpath(path.c_str(), buf)) return buf;
+    const size_t slash = path.rfind('/');
+    const std::string dir = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+    if (::realpath(dir.c_str(), buf)) return std::string(buf) + "/" + path.substr(slash + 1);
+    return path;
+}
+
+// 一个基础镜像: 原始镜像直接 mmap, 压缩镜像经共享缓存按块解码
+struct Base {
+    std::unique_ptr<MappedFile> raw;
+    std::unique_ptr<CompressedImage> compressed;
+    std::string error;  // 打开失败时, 使用它的任务全部失败
+};
+
+} // namespace
+
+std::vector<BatchJob> load_batch_manifest(const std::string& path, BatchOptions* opts) {
+    const std::string text = read_text(path);
+    const JsonValue root = JsonParser(text, path).parse();
+    auto bad = [&path](const std::string& why) {
+        return std::runtime_error("invalid batch manifest " + path + ": " + why);
+    };
+    if (root.type != JsonValue::Type::Object) throw bad("top level must be an object");
+
+    auto number = [&](const char* key, double max) -> const JsonValue* {
+        const JsonValue* v = root.get(key);
+        if (v && (v->type != JsonValue::Type::Number || v->number < 0 || v->number > max)) {
+            throw bad(std::string("\"") + key + "\" must be a non-negative number");
+        }
+        return v;
+    };
+    if (const JsonValue* v = number("threads", 4096)) opts->threads = unsigned(v->number);
+    if (const JsonValue* v = number("cache_mib", 1 << 20)) opts->cache_bytes = size_t(v->number) << 20;
+
+    const JsonValue* list = root.get("jobs");
+    if (!list || list->type != JsonValue::Type::Array) throw bad("missing \"jobs\" array");
+
+    const size_t slash = path.rfind('/');
+    const std::string dir = slash == std::string::npos ? std::string() : path.substr(0, slash);
+    std::vector<BatchJob> jobs;
+    for (size_t i = 0; i < list->items.size(); ++i) {
+        const JsonValue& j = list->items[i];
+        auto field = [&](const char* key, bool required) {
+            const JsonValue* v = j.type == JsonValue::Type::Object ? j.get(key) : nullptr;
+            if (v && v->type == JsonValue::Type::String && !v->str.empty()) return resolve(dir, v->str);
+            if (required || v) {
+                throw bad("job " + std::to_string(i) + ": \"" + key + "\" must be a non-empty string");
+            }
+            return std::string();
+        };
+        BatchJob job;
+        job.base = field("base", true);
+        job.patch = field("patch", true);
+        job.out = field("out", true);
+        job.journal = field("journal", false);
+        jobs.push_back(std::move(job));
+    }
+
+    // 任务并发执行, 写出的文件 (out / journal) 不能与其他任务写出或读取的文件相同
+    std::map<std::string, std::string> written;  // 规范路径 -> 首个写出它的任务
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        for (const std::string* p : {&jobs[i].out, &jobs[i].journal}) {
+            if (p->empty()) continue;
+            const std::string who = "job " + std::to_string(i);
+            auto ins = written.emplace(canonical(*p), who);
+            if (!ins.second) throw bad(who + ": " + *p + " is also written by " + ins.first->second);
+        }
+    }
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        for (const std::string* p : {&jobs[i].base, &jobs[i].patch}) {
+            auto it = written.find(canonical(*p));
+            if (it != written.end()) {
+                throw bad("job " + std::to_string(i) + ": " + *p + " is written by " + it->second);
+            }
+        }
+    }
+    return jobs;
+}
+
+BatchStats run_batch(const std::vector<BatchJob>& jobs, const BatchOptions& opts,
+                     std::vector<BatchJobResult>* results) {
+    BatchStats stats;
+    stats.jobs = jobs.size();
+    results->assign(jobs.size(), BatchJobResult());
+    if (jobs.empty()) return stats;
+
+    // 每个基础镜像只打开一次
+    std::map<std::string, uint32_t> base_ids;
+    std::vector<uint32_t> job_base(jobs.size());
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        auto ins = base_ids.emplace(canonical(jobs[i].base), uint32_t(base_ids.size()));
+        job_base[i] = ins.first->second;
+    }
+    std::vector<Base> bases(base_ids.size());
+    size_t block_size = 0;
+    for (const auto& b : base_ids) {
+        Base& base = bases[b.second];
+        try {
+            if (CompressedImage::detect(b.first)) {
+                base.compressed.reset(new CompressedImage(b.first));
+                block_size = std::max(block_size, base.compressed->chunk_size());
+                ++stats.compressed_bases;
+            } else {
+                base.raw.reset(new MappedFile(b.first));
+            }
+        } catch (const std::exception& e) {
+            base.error = e.what();
+        }
+    }
+    stats.bases = bases.size();
+
+    stats.threads = std::min<unsigned>(resolve_threads(opts.threads), unsigned(jobs.size()));
+    std::unique_ptr<BlockCache> cache;
+    if (block_size > 0) {
+        // 每个线程同时只引用一块, 容量至少要比线程数多一块
+        const size_t blocks = std::max(opts.cache_bytes / block_size, size_t(stats.threads) + 1);
+        cache.reset(new BlockCache(block_size, blocks));
+        stats.cache_blocks = blocks;
+    }
+
+    // 同一基础镜像的任务相邻调度, 并发执行时共享缓存中的块
+    std::vector<size_t> order(jobs.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::stable_sort(order.begin(), order.end(),
+                     [&](size_t a, size_t b) { return job_base[a] < job_base[b]; });
+
+    std::atomic<size_t> next{0};
+    auto worker = [&] {
+        // 每个线程一个 arena, 补丁窗口与写出缓冲区在该线程的各任务间复用
+        std::unique_ptr<Arena> arena;
+        for (size_t k; (k = next.fetch_add(1)) < order.size();) {
+            const size_t i = order[k];
+            const BatchJob& job = jobs[i];
+            const Base& base = bases[job_base[i]];
+            BatchJobResult& r = (*results)[i];
+            try {
+                if (!base.error.empty()) throw std::runtime_error(base.error);
+                if (!arena) arena.reset(new Arena(opts.apply.mem_limit));
+                DeltaApplyOptions apply = opts.apply;
+                apply.journal_path = job.journal;
+                if (base.compressed) {
+                    CachedBase reader(*base.compressed, job_base[i], *cache);
+                    r.stats = delta_apply(reader, job.patch, job.out, apply, *arena);
+                } else {
+                    MappedBase reader(*base.raw);
+                    r.stats = delta_apply(reader, job.patch, job.out, apply, *arena);
+                }
+                r.ok = true;
+            } catch (const std::exception& e) {
+                r.error = e.what();
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < stats.threads; ++t) {
+        pool.emplace_back([&worker] {
+            trace_thread_name("batch");
+            worker();
+        });
+    }
+    worker();
+    for (std::thread& t : pool) t.join();
+
+    for (const BatchJobResult& r : *results) stats.failed += r.ok ? 0 : 1;
+    if (cache) stats.cache = cache->stats();
+    return stats;
+}
+
+} // namespace ota
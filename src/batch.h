@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "base_cache.h"
+#include "delta.h"
+
+namespace ota {
+
+// 批量任务清单 (JSON), 相对路径相对于清单所在目录:
+//   {
+//     "threads": 8,          可选, 共享线程池大小
+//     "cache_mib": 256,      可选, 解压基础块缓存大小
+//     "jobs": [
+//       {"base": "base.lz", "patch": "sku1.delta", "out": "sku1.img", "journal": "sku1.jnl"},
+//       ...
+//     ]
+//   }
+// base 可以是原始镜像, 也可以是 compress 生成的 OTALZ401 载荷 (按块解压并缓存)。
+struct BatchJob {
+    std::string base;
+    std::string patch;
+    std::string out;
+    std::string journal;  // 可选
+};
+
+struct BatchOptions {
+    unsigned threads = 0;               // 0 = 硬件线程数
+    size_t cache_bytes = 256u << 20;    // 所有任务共享的解压块缓存
+    DeltaApplyOptions apply;            // journal_path 由各任务指定
+};
+
+struct BatchJobResult {
+    bool ok = false;
+    std::string error;
+    DeltaApplyStats stats;
+};
+
+struct BatchStats {
+    uint64_t jobs = 0;
+    uint64_t failed = 0;
+    size_t bases = 0;
+    size_t compressed_bases = 0;
+    size_t cache_blocks = 0;
+    unsigned threads = 0;
+    BlockCacheStats cache;
+};
+
+// 解析清单; 清单中的 threads / cache_mib 写入 opts。
+// 各任务的 out / journal 互不相同, 且不是任何任务的 base / patch, 否则抛出异常
+std::vector<BatchJob> load_batch_manifest(const std::string& path, BatchOptions* opts);
+
+// 在共享线程池上执行所有任务, 单个任务失败不影响其他任务。
+// 每个基础镜像只打开一次; 使用同一基础镜像的任务相邻调度, 压缩基础镜像的每一块
+// 在缓存容量足够时只解码一次。每个线程持有一个 apply.mem_limit 大小的 arena,
+// 补丁窗口与写出缓冲区在该线程执行的各任务间复用。results 按 jobs 的顺序给出各任务结果。
+// 调用方须保证各任务写出的文件互不相同 (见 load_batch_manifest)
+BatchStats run_batch(const std::vector<BatchJob>& jobs, const BatchOptions& opts,
+                     std::vector<BatchJobResult>* results);
+
+} // namespace ota
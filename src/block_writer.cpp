@@ -0,0 +1,366 @@
+#include "block_writer.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "file_io.h"
+#include "trace.h"
+
+namespace ota {
+
+namespace {
+
+void pwrite_all(int fd, const uint8_t* data, size_t len, uint64_t offset, const std::string& path) {
+    while (len > 0) {
+        const ssize_t w = ::pwrite(fd, data, len, off_t(offset));
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            throw io_error("cannot write", path);
+        }
+        data += w;
+        len -= size_t(w);
+        offset += uint64_t(w);
+    }
+}
+
+} // namespace
+
+bool parse_backend(const std::string& name, WriterOptions::Backend* out) {
+    if (name == "auto") {
+        *out = WriterOptions::Backend::Auto;
+    } else if (name == "uring") {
+        *out = WriterOptions::Backend::Uring;
+    } else if (name == "pwrite") {
+        *out = WriterOptions::Backend::Pwrite;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// 直接通过系统调用使用 io_uring, 不依赖 liburing。单线程提交与收割。
+class BlockWriter::Uring {
+public:
+    static std::unique_ptr<Uring> create(unsigned entries) {
+        std::unique_ptr<Uring> ring(new Uring());
+        if (!ring->setup(entries)) return nullptr;
+        return ring;
+    }
+
+    ~Uring() {
+        if (sqes_) ::munmap(sqes_, sqes_size_);
+        if (cq_ptr_ && cq_ptr_ != sq_ptr_) ::munmap(cq_ptr_, cq_size_);
+        if (sq_ptr_) ::munmap(sq_ptr_, sq_size_);
+        if (ring_fd_ >= 0) ::close(ring_fd_);
+    }
+
+    void submit_write(int fd, uint8_t* data, size_t len, uint64_t offset, uint64_t user_data) {
+        iov_[user_data].iov_base = data;
+        iov_[user_data].iov_len = len;
+
+        const unsigned tail = *sq_tail_;
+        const unsigned idx = tail & *sq_mask_;
+        io_uring_sqe* sqe = &sqes_[idx];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_WRITEV;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(&iov_[user_data]);
+        sqe->len = 1;
+        sqe->off = offset;
+        sqe->user_data = user_data;
+        sq_array_[idx] = idx;
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+
+        enter(1, 0, 0);
+    }
+
+    // 收割已完成的请求; wait 为真时至少等待一个
+    template <typename Fn>
+    void reap(bool wait, Fn on_complete) {
+        unsigned head = *cq_head_;
+        if (wait && head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+            enter(0, 1, IORING_ENTER_GETEVENTS);
+        }
+        const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            const io_uring_cqe& cqe = cqes_[head & *cq_mask_];
+            const uint64_t user_data = cqe.user_data;
+            const int32_t res = cqe.res;
+            ++head;
+            __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+            on_complete(user_data, res);
+        }
+    }
+
+private:
+    Uring() = default;
+
+    bool setup(unsigned entries) {
+        io_uring_params p;
+        std::memset(&p, 0, sizeof(p));
+        ring_fd_ = int(::syscall(__NR_io_uring_setup, entries, &p));
+        if (ring_fd_ < 0) return false;
+
+        sq_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        const bool single_mmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap) sq_size_ = cq_size_ = (sq_size_ > cq_size_ ? sq_size_ : cq_size_);
+
+        void* sq = ::mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ring_fd_, IORING_OFF_SQ_RING);
+        if (sq == MAP_FAILED) return false;
+        sq_ptr_ = static_cast<uint8_t*>(sq);
+
+        if (single_mmap) {
+            cq_ptr_ = sq_ptr_;
+        } else {
+            void* cq = ::mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                              ring_fd_, IORING_OFF_CQ_RING);
+            if (cq == MAP_FAILED) return false;
+            cq_ptr_ = static_cast<uint8_t*>(cq);
+        }
+
+        sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            ring_fd_, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            sqes_ = nullptr;
+            return false;
+        }
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+        sq_tail_ = reinterpret_cast<unsigned*>(sq_ptr_ + p.sq_off.tail);
+        sq_mask_ = reinterpret_cast<unsigned*>(sq_ptr_ + p.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned*>(sq_ptr_ + p.sq_off.array);
+        cq_head_ = reinterpret_cast<unsigned*>(cq_ptr_ + p.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq_ptr_ + p.cq_off.tail);
+        cq_mask_ = reinterpret_cast<unsigned*>(cq_ptr_ + p.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq_ptr_ + p.cq_off.cqes);
+
+        iov_.resize(entries);
+        return true;
+    }
+
+    void enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+        for (;;) {
+            const long r = ::syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete, flags,
+                                     nullptr, 0);
+            if (r >= 0) return;
+            if (errno != EINTR) throw io_error("io_uring_enter failed for", "ring");
+        }
+    }
+
+    int ring_fd_ = -1;
+    uint8_t* sq_ptr_ = nullptr;
+    uint8_t* cq_ptr_ = nullptr;
+    size_t sq_size_ = 0;
+    size_t cq_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_mask_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned* cq_mask_ = nullptr;
+    io_uring_cqe* cqes_ = nullptr;
+
+    std::vector<iovec> iov_;
+};
+
+BlockWriter::BlockWriter(const std::string& path, const WriterOptions& opts, uint64_t start_offset,
+                         Arena* arena)
+    : path_(path), opts_(opts), owned_(nullptr, std::free) {
+    if (opts_.queue_depth == 0) throw std::invalid_argument("queue depth must be non-zero");
+    if (opts_.buffer_size == 0) throw std::invalid_argument("buffer size must be non-zero");
+    opts_.buffer_size = (opts_.buffer_size + kDirectAlign - 1) / kDirectAlign * kDirectAlign;
+
+    const int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (start_offset == 0 ? O_TRUNC : 0);
+    if (opts_.direct) {
+        fd_ = ::open(path.c_str(), flags | O_DIRECT, 0644);
+        direct_ = fd_ >= 0;
+        // tmpfs 等不支持 O_DIRECT 的文件系统返回 EINVAL, 退回普通写
+        if (fd_ < 0 && errno != EINVAL) throw io_error("cannot open", path);
+    }
+    if (fd_ < 0) fd_ = ::open(path.c_str(), flags, 0644);
+    if (fd_ < 0) throw io_error("cannot open", path);
+
+    struct stat st;
+    if (::fstat(fd_, &st) == 0) regular_file_ = S_ISREG(st.st_mode);
+
+    if (direct_ && start_offset % kDirectAlign != 0) {
+        ::close(fd_);
+        throw std::invalid_argument("O_DIRECT resume offset must be 4 KiB aligned");
+    }
+
+    const size_t depth = opts_.queue_depth;
+    const size_t total = depth * opts_.buffer_size;
+    uint8_t* mem;
+    if (arena) {
+        mem = static_cast<uint8_t*>(arena->allocate(total, kDirectAlign));
+    } else {
+        void* p = nullptr;
+        if (::posix_memalign(&p, kDirectAlign, total) != 0) {
+            ::close(fd_);
+            throw std::bad_alloc();
+        }
+        owned_.reset(static_cast<uint8_t*>(p));
+        mem = owned_.get();
+    }
+    for (size_t i = 0; i < depth; ++i) buffers_.push_back(mem + i * opts_.buffer_size);
+    for (size_t i = depth; i > 1; --i) free_.push_back(i - 1);
+    cur_ = 0;
+    pending_offset_.assign(depth, 0);
+    pending_len_.assign(depth, 0);
+
+    if (opts_.backend != WriterOptions::Backend::Pwrite) {
+        uring_ = Uring::create(opts_.queue_depth);
+        if (!uring_ && opts_.backend == WriterOptions::Backend::Uring) {
+            ::close(fd_);
+            throw io_error("io_uring unavailable for", path);
+        }
+    }
+
+    submitted_ = last_sync_ = durable_ = start_offset;
+}
+
+BlockWriter::~BlockWriter() {
+    // 缓冲区释放前必须等内核完成所有在途写
+    try {
+        drain();
+    } catch (...) {
+    }
+    uring_.reset();
+    if (fd_ >= 0) ::close(fd_);
+}
+
+const char* BlockWriter::backend_name() const { return uring_ ? "io_uring" : "pwrite"; }
+
+uint8_t* BlockWriter::space(size_t* avail) {
+    *avail = opts_.buffer_size - fill_;
+    return buffers_[cur_] + fill_;
+}
+
+void BlockWriter::commit(size_t n) {
+    fill_ += n;
+    if (fill_ == opts_.buffer_size) submit_current();
+}
+
+void BlockWriter::write(const void* data, size_t len) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    while (len > 0) {
+        size_t avail = 0;
+        uint8_t* dst = space(&avail);
+        const size_t n = len < avail ? len : avail;
+        std::memcpy(dst, p, n);
+        commit(n);
+        p += n;
+        len -= n;
+    }
+}
+
+void BlockWriter::submit_current() {
+    submit(cur_, submitted_, fill_);
+    submitted_ += fill_;
+    fill_ = 0;
+    if (opts_.fsync_interval != 0 && submitted_ - last_sync_ >= opts_.fsync_interval) sync_data();
+    cur_ = acquire_buffer();
+}
+
+void BlockWriter::submit(size_t buf, uint64_t offset, size_t len) {
+    TraceSpan span(Stage::Write, len);
+    if (uring_) {
+        pending_offset_[buf] = offset;
+        pending_len_[buf] = len;
+        ++in_flight_;
+        uring_->submit_write(fd_, buffers_[buf], len, offset, buf);
+    } else {
+        pwrite_all(fd_, buffers_[buf], len, offset, path_);
+        free_.push_back(buf);
+    }
+}
+
+void BlockWriter::complete(size_t buf, int64_t res) {
+    --in_flight_;
+    free_.push_back(buf);
+    if (res < 0) {
+        errno = int(-res);
+        throw io_error("cannot write", path_);
+    }
+    // 短写时同步补齐剩余部分
+    const size_t done = size_t(res);
+    if (done < pending_len_[buf]) {
+        pwrite_all(fd_, buffers_[buf] + done, pending_len_[buf] - done, pending_offset_[buf] + done,
+                   path_);
+    }
+}
+
+void BlockWriter::reap(bool wait) {
+    if (!uring_ || in_flight_ == 0) return;
+    uring_->reap(wait, [this](uint64_t buf, int32_t res) { complete(size_t(buf), res); });
+}
+
+void BlockWriter::drain() {
+    while (in_flight_ > 0) reap(true);
+}
+
+size_t BlockWriter::acquire_buffer() {
+    if (free_.empty()) {
+        // 等待在途写完成的时间计入写出阶段
+        TraceSpan span(Stage::Write);
+        while (free_.empty()) reap(true);
+    }
+    const size_t buf = free_.back();
+    free_.pop_back();
+    return buf;
+}
+
+void BlockWriter::sync_data() {
+    TraceSpan span(Stage::Sync);
+    drain();
+    if (::fdatasync(fd_) != 0) throw io_error("cannot sync", path_);
+    last_sync_ = durable_ = submitted_;
+}
+
+void BlockWriter::finish() {
+    if (finished_) return;
+
+    if (fill_ > 0) {
+        const size_t aligned = direct_ ? (fill_ & ~(kDirectAlign - 1)) : fill_;
+        if (aligned > 0) submit(cur_, submitted_, aligned);
+        if (aligned < fill_) {
+            // O_DIRECT 要求长度对齐, 不足 4 KiB 的尾部经普通描述符写出
+            drain();
+            FileDescriptor tail(path_, O_WRONLY);
+            pwrite_all(tail.get(), buffers_[cur_] + aligned, fill_ - aligned, submitted_ + aligned,
+                       path_);
+            tail.sync();
+        }
+        submitted_ += fill_;
+        fill_ = 0;
+    }
+
+    TraceSpan span(Stage::Sync);
+    drain();
+    if (regular_file_ && ::ftruncate(fd_, off_t(submitted_)) != 0) {
+        throw io_error("cannot truncate", path_);
+    }
+    if (::fdatasync(fd_) != 0) throw io_error("cannot sync", path_);
+    last_sync_ = durable_ = submitted_;
+    finished_ = true;
+}
+
+} // namespace ota
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ota {
+
+class Arena;
+
+const size_t kDirectAlign = 4096;
+
+struct WriterOptions {
+    enum class Backend { Auto, Uring, Pwrite };
+
+    Backend backend = Backend::Auto;  // Auto: 内核支持时用 io_uring, 否则 pwrite
+    bool direct = false;              // O_DIRECT, 绕过页缓存; 文件系统不支持时自动退回
+    unsigned queue_depth = 4;         // 在途写请求数 (即缓冲区个数)
+    size_t buffer_size = 1u << 20;    // 单个缓冲区大小, 向上取整到 4 KiB
+    uint64_t fsync_interval = 64ull << 20;  // 每写出这么多字节 fdatasync 一次, 0 = 仅结束时
+};
+
+bool parse_backend(const std::string& name, WriterOptions::Backend* out);
+
+// 顺序写入块设备或普通文件。数据先进入对齐的缓冲区, 写满后异步提交,
+// 调用方继续填充下一个缓冲区, 计算与 I/O 重叠。
+class BlockWriter {
+public:
+    // start_offset > 0 时不截断文件, 从该偏移继续写; arena 非空时缓冲区从中分配
+    BlockWriter(const std::string& path, const WriterOptions& opts, uint64_t start_offset = 0,
+                Arena* arena = nullptr);
+    ~BlockWriter();
+
+    BlockWriter(const BlockWriter&) = delete;
+    BlockWriter& operator=(const BlockWriter&) = delete;
+
+    // 零拷贝接口: 取得当前缓冲区剩余空间, 填充后 commit
+    uint8_t* space(size_t* avail);
+    void commit(size_t n);
+
+    void write(const void* data, size_t len);
+
+    // 写出剩余数据, 等待全部完成并落盘; 普通文件截断到最终长度
+    void finish();
+
+    uint64_t offset() const { return submitted_ + fill_; }
+    uint64_t durable_offset() const { return durable_; }
+    const char* backend_name() const;
+    bool direct() const { return direct_; }
+
+private:
+    class Uring;
+
+    void submit_current();
+    void submit(size_t buf, uint64_t offset, size_t len);
+    void reap(bool wait);
+    void drain();
+    void sync_data();
+    void complete(size_t buf, int64_t res);
+    size_t acquire_buffer();
+
+    std::string path_;
+    WriterOptions opts_;
+    int fd_ = -1;
+    bool direct_ = false;
+    bool regular_file_ = false;
+    std::unique_ptr<Uring> uring_;
+
+    std::unique_ptr<uint8_t, void (*)(void*)> owned_;
+    std::vector<uint8_t*> buffers_;
+    std::vector<size_t> free_;
+    std::vector<uint64_t> pending_offset_;
+    std::vector<size_t> pending_len_;
+    size_t in_flight_ = 0;
+
+    size_t cur_ = 0;
+    size_t fill_ = 0;
+    uint64_t submitted_ = 0;
+    uint64_t last_sync_ = 0;
+    uint64_t durable_ = 0;
+    bool finished_ = false;
+};
+
+} // namespace ota
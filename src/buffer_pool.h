@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#include "bounded_queue.h"
+
+namespace ota {
+
+// 预分配的定长缓冲区池, 空闲链为无锁队列; 处理过程中不再有堆分配
+class BufferPool {
+public:
+    BufferPool(size_t count, size_t buffer_size, size_t alignment = kCacheLine)
+        : buffer_size_(buffer_size), free_(round_up_pow2(count)) {
+        const size_t stride = (buffer_size + alignment - 1) / alignment * alignment;
+        void* mem = nullptr;
+        if (count > 0 && ::posix_memalign(&mem, alignment, stride * count) != 0) throw std::bad_alloc();
+        storage_ = static_cast<uint8_t*>(mem);
+        for (size_t i = 0; i < count; ++i) free_.push(storage_ + i * stride);
+        count_ = count;
+    }
+
+    ~BufferPool() { std::free(storage_); }
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // 阻塞直到有空闲缓冲区
+    uint8_t* acquire() {
+        uint8_t* buf = nullptr;
+        Backoff backoff;
+        while (!free_.try_pop(buf)) backoff.pause();
+        return buf;
+    }
+
+    bool try_acquire(uint8_t*& buf) { return free_.try_pop(buf); }
+
+    void release(uint8_t* buf) { free_.push(buf); }
+
+    size_t buffer_size() const { return buffer_size_; }
+    size_t count() const { return count_; }
+
+private:
+    size_t buffer_size_;
+    size_t count_ = 0;
+    uint8_t* storage_ = nullptr;
+    BoundedQueue<uint8_t*> free_;
+};
+
+} // namespace ota
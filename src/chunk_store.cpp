@@ -0,0 +1,213 @@
+#include "chunk_store.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+namespace ota {
+
+namespace {
+
+const char kIndexMagic[8] = {'O', 'T', 'A', 'C', 'I', 'X', '0', '2'};
+const char kIndexMagicV1[8] = {'O', 'T', 'A', 'C', 'I', 'X', '0', '1'};
+const size_t kIndexHeaderSize = 64;
+
+uint64_t slot_hash(const uint8_t* digest) {
+    uint64_t h;
+    std::memcpy(&h, digest, sizeof(h));
+    return h;
+}
+
+const std::string& make_dir(const std::string& dir) {
+    if (::mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) throw io_error("cannot create", dir);
+    return dir;
+}
+
+} // namespace
+
+ChunkIndex::ChunkIndex(const std::string& path, uint64_t initial_capacity) : path_(path) {
+    struct stat st;
+    if (::stat(path.c_str(), &st) == 0) {
+        map(path, 0, false);
+    } else {
+        uint64_t cap = 16;
+        while (cap < initial_capacity) cap <<= 1;
+        map(path, cap, true);
+    }
+}
+
+ChunkIndex::~ChunkIndex() { unmap(); }
+
+void ChunkIndex::map(const std::string& path, uint64_t capacity, bool create) {
+    FileDescriptor fd(path, O_RDWR | (create ? O_CREAT | O_TRUNC : 0));
+    if (create) {
+        map_size_ = size_t(kIndexHeaderSize + capacity * sizeof(IndexSlot));
+        if (::ftruncate(fd.get(), off_t(map_size_)) != 0) throw io_error("cannot size", path);
+    } else {
+        struct stat st;
+        if (::fstat(fd.get(), &st) != 0) throw io_error("cannot stat", path);
+        map_size_ = size_t(st.st_size);
+        if (map_size_ < kIndexHeaderSize) throw std::runtime_error("corrupt chunk index " + path);
+    }
+
+    void* p = ::mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd.get(), 0);
+    if (p == MAP_FAILED) throw io_error("cannot mmap", path);
+    map_ = static_cast<uint8_t*>(p);
+
+    if (create) {
+        std::memcpy(map_, kIndexMagic, 8);
+        put_le64(map_ + 8, capacity);
+        put_le64(map_ + 16, 0);
+        put_le64(map_ + 24, 0);
+    } else if ((std::memcmp(map_, kIndexMagic, 8) != 0 &&
+                std::memcmp(map_, kIndexMagicV1, 8) != 0) ||
+               kIndexHeaderSize + get_le64(map_ + 8) * sizeof(IndexSlot) != map_size_) {
+        unmap();
+        throw std::runtime_error("corrupt chunk index " + path);
+    }
+    capacity_ = get_le64(map_ + 8);
+    slots_ = reinterpret_cast<IndexSlot*>(map_ + kIndexHeaderSize);
+}
+
+void ChunkIndex::unmap() {
+    if (map_) ::munmap(map_, map_size_);
+    map_ = nullptr;
+    slots_ = nullptr;
+}
+
+uint64_t ChunkIndex::size() const { return get_le64(map_ + 16); }
+
+uint64_t ChunkIndex::pack_size() const {
+    return std::memcmp(map_, kIndexMagic, 8) == 0 ? get_le64(map_ + 24) : UINT64_MAX;
+}
+
+void ChunkIndex::set_pack_size(uint64_t size) {
+    put_le64(map_ + 24, size);
+    std::memcpy(map_, kIndexMagic, 8);  // OTACIX01 在此升级
+}
+
+IndexSlot* ChunkIndex::probe(const Digest& digest) const {
+    const uint64_t mask = capacity_ - 1;
+    for (uint64_t i = slot_hash(digest.data()) & mask;; i = (i + 1) & mask) {
+        IndexSlot* s = &slots_[i];
+        if (!s->used || std::memcmp(s->digest, digest.data(), 32) == 0) return s;
+    }
+}
+
+const IndexSlot* ChunkIndex::find(const Digest& digest) const {
+    const IndexSlot* s = probe(digest);
+    return s->used ? s : nullptr;
+}
+
+void ChunkIndex::insert(const Digest& digest, uint64_t offset, uint32_t length) {
+    if ((size() + 1) * 4 > capacity_ * 3) rebuild(capacity_ * 2, UINT64_MAX);
+    IndexSlot* s = probe(digest);
+    if (s->used) return;
+    std::memcpy(s->digest, digest.data(), 32);
+    s->offset = offset;
+    s->length = length;
+    s->used = 1;
+    put_le64(map_ + 16, size() + 1);
+}
+
+void ChunkIndex::drop_past(uint64_t pack_size) {
+    for (uint64_t i = 0; i < capacity_; ++i) {
+        const IndexSlot& s = slots_[i];
+        if (s.used && s.offset + s.length > pack_size) {
+            rebuild(capacity_, pack_size);
+            return;
+        }
+    }
+}
+
+void ChunkIndex::rebuild(uint64_t capacity, uint64_t pack_size) {
+    const std::string tmp = path_ + ".tmp";
+    ::unlink(tmp.c_str());  // 上次重建中断留下的残余
+    {
+        ChunkIndex fresh(tmp, capacity);
+        for (uint64_t i = 0; i < capacity_; ++i) {
+            const IndexSlot& s = slots_[i];
+            if (!s.used || s.offset + s.length > pack_size) continue;
+            Digest d;
+            std::memcpy(d.data(), s.digest, 32);
+            fresh.insert(d, s.offset, s.length);
+        }
+        fresh.set_pack_size(this->pack_size());
+        fresh.sync();
+    }
+    if (std::rename(tmp.c_str(), path_.c_str()) != 0) throw io_error("cannot replace", path_);
+    unmap();
+    map(path_, 0, false);
+}
+
+void ChunkIndex::sync() {
+    if (::msync(map_, map_size_, MS_SYNC) != 0) throw io_error("cannot sync", path_);
+}
+
+ChunkStore::ChunkStore(const std::string& dir)
+    : dir_(make_dir(dir)),
+      pack_(dir + "/chunks.pack", O_RDWR | O_CREAT),
+      index_(dir + "/chunks.idx") {
+    const off_t end = ::lseek(pack_.get(), 0, SEEK_END);
+    if (end < 0) throw io_error("cannot seek", pack_.path());
+
+    // 上次 flush 之后追加的数据可能不完整, 而索引可能已先于 pack 落盘:
+    // 截断 pack 并删除指向截断部分的条目, 这些块在下次 put 时重新写入
+    pack_end_ = std::min(uint64_t(end), index_.pack_size());
+    if (pack_end_ < uint64_t(end)) {
+        if (::ftruncate(pack_.get(), off_t(pack_end_)) != 0 ||
+            ::lseek(pack_.get(), off_t(pack_end_), SEEK_SET) < 0) {
+            throw io_error("cannot truncate", pack_.path());
+        }
+    }
+    index_.drop_past(pack_end_);
+    if (index_.pack_size() != pack_end_) {
+        index_.set_pack_size(pack_end_);
+        index_.sync();
+    }
+}
+
+bool ChunkStore::put(const Digest& digest, const uint8_t* data, uint32_t length) {
+    if (index_.find(digest)) return false;
+    pack_.write_full(data, length);
+    index_.insert(digest, pack_end_, length);
+    pack_end_ += length;
+    return true;
+}
+
+const uint8_t* ChunkStore::get(const Digest& digest, uint32_t* length) {
+    const IndexSlot* s = index_.find(digest);
+    if (!s) return nullptr;
+    if (s->offset + s->length > pack_end_) {
+        throw std::runtime_error("chunk index points past end of " + pack_.path());
+    }
+    // pack 只追加, 映射范围不足时重新映射
+    if (!pack_map_ || pack_map_->size() < s->offset + s->length) {
+        pack_map_.reset(new MappedFile(pack_.path()));
+    }
+    const uint8_t* data = pack_map_->data() + s->offset;
+    TraceSpan span(Stage::Verify, s->length);
+    if (Sha256::hash(data, s->length) != digest) {
+        throw std::runtime_error("chunk " + to_hex(digest) + " in " + pack_.path() +
+                                 " does not match its digest");
+    }
+    *length = s->length;
+    return data;
+}
+
+void ChunkStore::flush() {
+    pack_.sync();
+    index_.set_pack_size(pack_end_);
+    index_.sync();
+}
+
+} // namespace ota
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "file_io.h"
+#include "mapped_file.h"
+#include "sha256.h"
+
+namespace ota {
+
+// 磁盘上的开放寻址哈希索引 (线性探测), 直接 mmap 查询, 无需反序列化:
+//   header (64B): magic "OTACIX02" | capacity u64 (2 的幂) | count u64 | pack_size u64
+//   slots:        capacity 个 48 字节槽: digest[32] | offset u64 | length u32 | used u32
+// 探测起点取摘要前 8 字节, 相邻槽连续存放, 一次探测通常只触及一两条缓存行。
+// pack_size 为最近一次 flush 时已落盘的 pack 长度; 旧的 OTACIX01 索引没有该字段。
+struct IndexSlot {
+    uint8_t digest[32];
+    uint64_t offset;
+    uint32_t length;
+    uint32_t used;
+};
+static_assert(sizeof(IndexSlot) == 48, "index slot layout");
+
+class ChunkIndex {
+public:
+    ChunkIndex(const std::string& path, uint64_t initial_capacity = 1u << 16);
+    ~ChunkIndex();
+
+    ChunkIndex(const ChunkIndex&) = delete;
+    ChunkIndex& operator=(const ChunkIndex&) = delete;
+
+    const IndexSlot* find(const Digest& digest) const;
+    // 负载超过 3/4 时以 2 倍容量重建文件并原子替换
+    void insert(const Digest& digest, uint64_t offset, uint32_t length);
+    void sync();
+
+    uint64_t size() const;
+    uint64_t capacity() const { return capacity_; }
+
+    // 已落盘的 pack 长度, 旧格式返回 UINT64_MAX
+    uint64_t pack_size() const;
+    void set_pack_size(uint64_t size);
+    // 删除越过 pack_size 的条目; 线性探测表不能直接删槽, 有条目需要删除时整体重建
+    void drop_past(uint64_t pack_size);
+
+private:
+    void map(const std::string& path, uint64_t capacity, bool create);
+    void unmap();
+    // 以 capacity 重建, 只保留 [0, pack_size) 内的条目
+    void rebuild(uint64_t capacity, uint64_t pack_size);
+    IndexSlot* probe(const Digest& digest) const;
+
+    std::string path_;
+    uint8_t* map_ = nullptr;
+    size_t map_size_ = 0;
+    uint64_t capacity_ = 0;
+    IndexSlot* slots_ = nullptr;
+};
+
+// 去重块存储: 目录下 chunks.pack 顺序追加块数据, chunks.idx 为按 SHA-256 寻址的索引
+class ChunkStore {
+public:
+    explicit ChunkStore(const std::string& dir);
+
+    // 打开时把 pack 截断到上次 flush 落盘的长度, 并删除指向截断部分的索引条目,
+    // 因此崩溃前未 flush 的块视为不存在, 之后重新 put 即可
+    bool contains(const Digest& digest) const { return index_.find(digest) != nullptr; }
+    // 块不存在时写入, 返回是否为新块
+    bool put(const Digest& digest, const uint8_t* data, uint32_t length);
+    // 返回块数据 (映射自 pack 文件), 不存在时返回 nullptr; 数据与摘要不符时抛出异常
+    const uint8_t* get(const Digest& digest, uint32_t* length);
+    // pack 先落盘, 再把其长度与索引一起持久化
+    void flush();
+
+    uint64_t chunk_count() const { return index_.size(); }
+    uint64_t pack_size() const { return pack_end_; }
+
+private:
+    std::string dir_;
+    FileDescriptor pack_;
+    uint64_t pack_end_ = 0;
+    ChunkIndex index_;
+    std::unique_ptr<MappedFile> pack_map_;
+};
+
+} // namespace ota
@@ -0,0 +1,70 @@
+#include "crc32c.h"
+
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <nmmintrin.h>
+#define OTA_HAVE_X86_64 1
+#endif
+
+namespace ota {
+
+namespace {
+
+struct Table {
+    uint32_t t[256];
+    Table() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? (c >> 1) ^ 0x82F63B78u : c >> 1;
+            t[i] = c;
+        }
+    }
+};
+
+uint32_t crc32c_table(uint32_t crc, const uint8_t* p, size_t len) {
+    static const Table table;
+    while (len--) crc = table.t[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+#ifdef OTA_HAVE_X86_64
+__attribute__((target("sse4.2")))
+uint32_t crc32c_sse42(uint32_t crc, const uint8_t* p, size_t len) {
+    uint64_t c = crc;
+    while (len >= 8) {
+        uint64_t v;
+        std::memcpy(&v, p, 8);
+        c = _mm_crc32_u64(c, v);
+        p += 8;
+        len -= 8;
+    }
+    uint32_t c32 = uint32_t(c);
+    while (len--) c32 = _mm_crc32_u8(c32, *p++);
+    return c32;
+}
+
+bool cpu_has_sse42() {
+    unsigned eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2) != 0;
+}
+#endif
+
+using CrcFn = uint32_t (*)(uint32_t, const uint8_t*, size_t);
+
+CrcFn select_impl() {
+#ifdef OTA_HAVE_X86_64
+    if (cpu_has_sse42()) return crc32c_sse42;
+#endif
+    return crc32c_table;
+}
+
+} // namespace
+
+uint32_t crc32c(uint32_t crc, const void* data, size_t len) {
+    static const CrcFn fn = select_impl();
+    return ~fn(~crc, static_cast<const uint8_t*>(data), len);
+}
+
+} // namespace ota
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ota {
+
+// CRC-32C (Castagnoli)。支持 SSE4.2 时使用 crc32 指令, 否则查表。
+// 用法: crc = crc32c(0, a, n); crc = crc32c(crc, b, m);
+uint32_t crc32c(uint32_t crc, const void* data, size_t len);
+
+} // namespace ota
@@ -0,0 +1,119 @@
+#include "dedup.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+
+#include "chunk_store.h"
+#include "file_io.h"
+#include "mapped_file.h"
+#include "sha256.h"
+#include "trace.h"
+
+namespace ota {
+
+namespace {
+
+std::runtime_error corrupt(const std::string& path, const std::string& why) {
+    return std::runtime_error("corrupt recipe " + path + ": " + why);
+}
+
+} // namespace
+
+DedupStats store_image(const std::string& image_path, const std::string& store_dir,
+                       const std::string& recipe_path, const CdcParams& params) {
+    const FastCdc cdc(params);
+    MappedFile image(image_path);
+    image.advise_sequential();
+    ChunkStore store(store_dir);
+
+    DedupStats stats;
+    stats.image_size = image.size();
+
+    std::vector<uint8_t> entries;
+    Sha256 whole;
+    uint64_t released = 0;
+    for (uint64_t pos = 0; pos < image.size();) {
+        const uint8_t* chunk = image.data() + pos;
+        const size_t len = cdc.next_cut(chunk, size_t(image.size() - pos));
+        const Digest digest = Sha256::hash(chunk, len);
+        whole.update(chunk, len);
+
+        if (store.put(digest, chunk, uint32_t(len))) {
+            ++stats.new_chunks;
+            stats.new_bytes += len;
+        }
+
+        const size_t at = entries.size();
+        entries.resize(at + kRecipeEntrySize);
+        std::memcpy(&entries[at], digest.data(), 32);
+        put_le32(&entries[at + 32], uint32_t(len));
+
+        ++stats.chunks;
+        pos += len;
+        // 按 8 MiB 批量归还已处理的页
+        if (pos - released >= (8u << 20)) {
+            image.release(released, pos - released);
+            released = pos;
+        }
+    }
+    store.flush();
+
+    uint8_t header[kRecipeHeaderSize];
+    std::memcpy(header, kRecipeMagic, 8);
+    put_le64(header + 8, stats.image_size);
+    put_le64(header + 16, stats.chunks);
+    const Digest digest = whole.finish();
+    std::memcpy(header + 24, digest.data(), 32);
+
+    FileDescriptor recipe(recipe_path, O_WRONLY | O_CREAT | O_TRUNC);
+    recipe.write_full(header, sizeof(header));
+    recipe.write_full(entries.data(), entries.size());
+    recipe.sync();
+    return stats;
+}
+
+uint64_t restore_image(const std::string& recipe_path, const std::string& store_dir,
+                       const std::string& out_path, const WriterOptions& writer_opts) {
+    MappedFile recipe(recipe_path);
+    if (recipe.size() < kRecipeHeaderSize || std::memcmp(recipe.data(), kRecipeMagic, 8) != 0) {
+        throw corrupt(recipe_path, "bad header");
+    }
+    const uint8_t* hdr = recipe.data();
+    const uint64_t image_size = get_le64(hdr + 8);
+    const uint64_t count = get_le64(hdr + 16);
+    if ((recipe.size() - kRecipeHeaderSize) / kRecipeEntrySize != count ||
+        (recipe.size() - kRecipeHeaderSize) % kRecipeEntrySize != 0) {
+        throw corrupt(recipe_path, "entry count does not match file size");
+    }
+    Digest expected;
+    std::memcpy(expected.data(), hdr + 24, 32);
+
+    ChunkStore store(store_dir);
+    BlockWriter out(out_path, writer_opts);
+    Sha256 whole;
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < count; ++i) {
+        const uint8_t* e = hdr + kRecipeHeaderSize + i * kRecipeEntrySize;
+        Digest digest;
+        std::memcpy(digest.data(), e, 32);
+        uint32_t len = 0;
+        const uint8_t* data = store.get(digest, &len);
+        if (!data) throw std::runtime_error("chunk " + to_hex(digest) + " missing from store");
+        if (len != get_le32(e + 32)) throw corrupt(recipe_path, "chunk length mismatch");
+        out.write(data, len);
+        TraceSpan span(Stage::Verify, len);
+        whole.update(data, len);
+        total += len;
+    }
+    out.finish();
+
+    if (total != image_size || whole.finish() != expected) {
+        throw std::runtime_error("restored image " + out_path + " does not match recipe digest");
+    }
+    return total;
+}
+
+} // namespace ota
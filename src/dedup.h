@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "block_writer.h"
+#include "fastcdc.h"
+
+namespace ota {
+
+// 镜像配方: 按顺序列出组成镜像的块 (小端)
+//   header:  magic "OTARCP01" | image_size u64 | chunk_count u64 | image_sha256[32]
+//   entries: digest[32] | length u32
+const char kRecipeMagic[8] = {'O', 'T', 'A', 'R', 'C', 'P', '0', '1'};
+const size_t kRecipeHeaderSize = 8 + 8 + 8 + 32;
+const size_t kRecipeEntrySize = 32 + 4;
+
+struct DedupStats {
+    uint64_t image_size = 0;
+    uint64_t chunks = 0;
+    uint64_t new_chunks = 0;
+    uint64_t new_bytes = 0;
+};
+
+// 对镜像做内容定义分块, 新块写入存储, 并生成配方
+DedupStats store_image(const std::string& image_path, const std::string& store_dir,
+                       const std::string& recipe_path, const CdcParams& params);
+
+// 按配方从存储中还原镜像, 校验整体 SHA-256
+uint64_t restore_image(const std::string& recipe_path, const std::string& store_dir,
+                       const std::string& out_path, const WriterOptions& writer);
+
+} // namespace ota
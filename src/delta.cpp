@@ -0,0 +1,696 @@
+#include "delta.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "block_writer.h"
+#include "crc32c.h"
+#include "file_io.h"
+#include "journal.h"
+#include "mapped_file.h"
+#include "pipeline.h"
+#include "trace.h"
+
+namespace ota {
+
+namespace {
+
+std::runtime_error corrupt(const std::string& path, const std::string& why) {
+    return std::runtime_error("corrupt patch " + path + ": " + why);
+}
+
+// ---- 后缀数组: Larsson & Sadakane qsufsort ----
+// Idx 必须为有符号类型 (已排好的组以负长度标记); base < 2 GiB 时用 int32_t 以减半内存
+
+template <typename Idx>
+void split(Idx* I, Idx* V, Idx start, Idx len, Idx h) {
+    for (;;) {
+        if (len < 16) {
+            Idx j;
+            for (Idx k = start; k < start + len; k += j) {
+                j = 1;
+                Idx x = V[I[k] + h];
+                for (Idx i = 1; k + i < start + len; ++i) {
+                    if (V[I[k + i] + h] < x) {
+                        x = V[I[k + i] + h];
+                        j = 0;
+                    }
+                    if (V[I[k + i] + h] == x) {
+                        std::swap(I[k + j], I[k + i]);
+                        ++j;
+                    }
+                }
+                for (Idx i = 0; i < j; ++i) V[I[k + i]] = k + j - 1;
+                if (j == 1) I[k] = -1;
+            }
+            return;
+        }
+
+        const Idx x = V[I[start + len / 2] + h];
+        Idx jj = 0, kk = 0;
+        for (Idx i = start; i < start + len; ++i) {
+            if (V[I[i] + h] < x) ++jj;
+            if (V[I[i] + h] == x) ++kk;
+        }
+        jj += start;
+        kk += jj;
+
+        Idx i = start, j = 0, k = 0;
+        while (i < jj) {
+            if (V[I[i] + h] < x) {
+                ++i;
+            } else if (V[I[i] + h] == x) {
+                std::swap(I[i], I[jj + j]);
+                ++j;
+            } else {
+                std::swap(I[i], I[kk + k]);
+                ++k;
+            }
+        }
+        while (jj + j < kk) {
+            if (V[I[jj + j] + h] == x) {
+                ++j;
+            } else {
+                std::swap(I[jj + j], I[kk + k]);
+                ++k;
+            }
+        }
+
+        if (jj > start) split(I, V, start, Idx(jj - start), h);
+
+        for (i = 0; i < kk - jj; ++i) V[I[jj + i]] = kk - 1;
+        if (jj == kk - 1) I[jj] = -1;
+
+        // 右半部分迭代处理, 减少递归深度
+        if (start + len <= kk) return;
+        len = start + len - kk;
+        start = kk;
+    }
+}
+
+template <typename Idx>
+void qsufsort(std::vector<Idx>& I_vec, const uint8_t* old, Idx oldsize) {
+    I_vec.assign(size_t(oldsize) + 1, 0);
+    std::vector<Idx> V_vec(size_t(oldsize) + 1, 0);
+    Idx* I = I_vec.data();
+    Idx* V = V_vec.data();
+
+    Idx buckets[256] = {};
+    for (Idx i = 0; i < oldsize; ++i) ++buckets[old[i]];
+    for (int i = 1; i < 256; ++i) buckets[i] += buckets[i - 1];
+    for (int i = 255; i > 0; --i) buckets[i] = buckets[i - 1];
+    buckets[0] = 0;
+
+    for (Idx i = 0; i < oldsize; ++i) I[++buckets[old[i]]] = i;
+    I[0] = oldsize;
+    for (Idx i = 0; i < oldsize; ++i) V[i] = buckets[old[i]];
+    V[oldsize] = 0;
+    for (int i = 1; i < 256; ++i) {
+        if (buckets[i] == buckets[i - 1] + 1) I[buckets[i]] = -1;
+    }
+    I[0] = -1;
+
+    for (Idx h = 1; I[0] != -(oldsize + 1); h += h) {
+        Idx len = 0;
+        Idx i = 0;
+        while (i < oldsize + 1) {
+            if (I[i] < 0) {
+                len -= I[i];
+                i -= I[i];
+            } else {
+                if (len) I[i - len] = -len;
+                len = V[I[i]] + 1 - i;
+                split(I, V, i, len, h);
+                i += len;
+                len = 0;
+            }
+        }
+        if (len) I[i - len] = -len;
+    }
+
+    for (Idx i = 0; i < oldsize + 1; ++i) I[V[i]] = i;
+}
+
+int64_t matchlen(const uint8_t* a, int64_t alen, const uint8_t* b, int64_t blen) {
+    const int64_t n = std::min(alen, blen);
+    int64_t i = 0;
+    while (i < n && a[i] == b[i]) ++i;
+    return i;
+}
+
+template <typename Idx>
+int64_t search(const Idx* I, const uint8_t* old, int64_t oldsize, const uint8_t* nw,
+               int64_t nwsize, int64_t st, int64_t en, int64_t* pos) {
+    while (en - st >= 2) {
+        const int64_t x = st + (en - st) / 2;
+        const int64_t cmplen = std::min(oldsize - int64_t(I[x]), nwsize);
+        const int c = cmplen > 0 ? std::memcmp(old + I[x], nw, size_t(cmplen)) : 0;
+        if (c < 0) {
+            st = x;
+        } else {
+            en = x;
+        }
+    }
+    const int64_t x = matchlen(old + I[st], oldsize - I[st], nw, nwsize);
+    const int64_t y = matchlen(old + I[en], oldsize - I[en], nw, nwsize);
+    if (x > y) {
+        *pos = I[st];
+        return x;
+    }
+    *pos = I[en];
+    return y;
+}
+
+// 补丁头原样写出, 记录流按 kDeltaChunkSize 分块压缩成 OTALZ401 帧
+class PatchWriter {
+public:
+    PatchWriter(const std::string& path, const uint8_t* header, size_t header_len)
+        : path_(path), buf_(kDeltaChunkSize), packed_(kDeltaChunkSize) {
+        fp_ = std::fopen(path.c_str(), "wb");
+        if (!fp_) throw io_error("cannot create", path);
+        write(header, header_len);
+        uint8_t frame[kFrameHeaderSize];
+        put_frame_header(frame, kDeltaChunkSize);
+        write(frame, sizeof(frame));
+    }
+    ~PatchWriter() {
+        if (fp_) std::fclose(fp_);
+    }
+
+    void put(const void* data, size_t len) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        while (len > 0) {
+            const size_t n = std::min(len, buf_.size() - fill_);
+            std::memcpy(buf_.data() + fill_, p, n);
+            fill_ += n;
+            p += n;
+            len -= n;
+            if (fill_ == buf_.size()) flush();
+        }
+    }
+
+    void put_u64(uint64_t v) {
+        uint8_t b[8];
+        put_le64(b, v);
+        put(b, 8);
+    }
+
+    // 写出最后一块与结束标记, 返回补丁文件大小
+    uint64_t close() {
+        flush();
+        const uint8_t end[kChunkHeaderSize] = {};
+        write(end, sizeof(end));
+        if (std::fclose(fp_) != 0) {
+            fp_ = nullptr;
+            throw io_error("cannot close", path_);
+        }
+        fp_ = nullptr;
+        return written_;
+    }
+
+private:
+    void flush() {
+        if (fill_ == 0) return;
+        const ChunkHeader h = encode_chunk(buf_.data(), fill_, packed_.data());
+        uint8_t hdr[kChunkHeaderSize];
+        put_chunk_header(hdr, h);
+        write(hdr, sizeof(hdr));
+        write(packed_.data(), h.payload_len);
+        fill_ = 0;
+    }
+
+    void write(const void* data, size_t len) {
+        if (std::fwrite(data, 1, len, fp_) != len) throw io_error("cannot write", path_);
+        written_ += len;
+    }
+
+    std::string path_;
+    std::FILE* fp_ = nullptr;
+    std::vector<uint8_t> buf_;
+    std::vector<uint8_t> packed_;
+    size_t fill_ = 0;
+    uint64_t written_ = 0;
+};
+
+template <typename Idx>
+DeltaDiffStats diff_impl(const uint8_t* old, int64_t oldsize, const uint8_t* nw, int64_t newsize,
+                         PatchWriter& out) {
+    std::vector<Idx> I;
+    qsufsort<Idx>(I, old, Idx(oldsize));
+
+    DeltaDiffStats stats;
+    std::vector<uint8_t> db;
+
+    int64_t scan = 0, len = 0, pos = 0;
+    int64_t lastscan = 0, lastpos = 0, lastoffset = 0;
+    while (scan < newsize) {
+        int64_t oldscore = 0;
+        int64_t scsc = scan += len;
+        for (; scan < newsize; ++scan) {
+            len = search<Idx>(I.data(), old, oldsize, nw + scan, newsize - scan, 0, oldsize, &pos);
+            for (; scsc < scan + len; ++scsc) {
+                const int64_t o = scsc + lastoffset;
+                if (o >= 0 && o < oldsize && old[o] == nw[scsc]) ++oldscore;
+            }
+            if ((len == oldscore && len != 0) || len > oldscore + 8) break;
+            const int64_t o = scan + lastoffset;
+            if (o >= 0 && o < oldsize && old[o] == nw[scan]) --oldscore;
+        }
+
+        if (len == oldscore && scan != newsize) continue;
+
+        // 向前扩展上一个匹配
+        int64_t s = 0, sf = 0, lenf = 0;
+        for (int64_t i = 0; lastscan + i < scan && lastpos + i < oldsize;) {
+            if (old[lastpos + i] == nw[lastscan + i]) ++s;
+            ++i;
+            if (s * 2 - i > sf * 2 - lenf) {
+                sf = s;
+                lenf = i;
+            }
+        }
+
+        // 向后扩展当前匹配
+        int64_t lenb = 0;
+        if (scan < newsize) {
+            int64_t sb = 0;
+            s = 0;
+            for (int64_t i = 1; scan >= lastscan + i && pos >= i; ++i) {
+                if (old[pos - i] == nw[scan - i]) ++s;
+                if (s * 2 - i > sb * 2 - lenb) {
+                    sb = s;
+                    lenb = i;
+                }
+            }
+        }
+
+        // 两段重叠时取最优分界
+        if (lastscan + lenf > scan - lenb) {
+            const int64_t overlap = (lastscan + lenf) - (scan - lenb);
+            int64_t ss = 0, lens = 0;
+            s = 0;
+            for (int64_t i = 0; i < overlap; ++i) {
+                if (nw[lastscan + lenf - overlap + i] == old[lastpos + lenf - overlap + i]) ++s;
+                if (nw[scan - lenb + i] == old[pos - lenb + i]) --s;
+                if (s > ss) {
+                    ss = s;
+                    lens = i + 1;
+                }
+            }
+            lenf += lens - overlap;
+            lenb -= lens;
+        }
+
+        const int64_t extra = (scan - lenb) - (lastscan + lenf);
+        const int64_t seek = (pos - lenb) - (lastpos + lenf);
+
+        out.put_u64(uint64_t(lenf));
+        out.put_u64(uint64_t(extra));
+        out.put_u64(uint64_t(seek));
+
+        db.resize(size_t(lenf));
+        for (int64_t i = 0; i < lenf; ++i) db[size_t(i)] = uint8_t(nw[lastscan + i] - old[lastpos + i]);
+        out.put(db.data(), db.size());
+        out.put(nw + lastscan + lenf, size_t(extra));
+
+        ++stats.records;
+        stats.diff_bytes += uint64_t(lenf);
+        stats.extra_bytes += uint64_t(extra);
+
+        lastscan = scan - lenb;
+        lastpos = pos - lenb;
+        lastoffset = pos - scan;
+    }
+    return stats;
+}
+
+// 补丁的顺序读取窗口, 缓冲区来自 arena。
+// OTADLT02 的记录流逐块解压, 同时只驻留一块压缩数据与一块解压数据;
+// 旧的 OTADLT01 补丁未压缩, 按 capacity 直接读入窗口
+class PatchReader {
+public:
+    PatchReader(const std::string& path, Arena& arena, size_t capacity) : fd_(path, O_RDONLY) {
+        uint8_t header[kDeltaHeaderSize];
+        if (fd_.read_full(header, sizeof(header)) != sizeof(header)) {
+            throw corrupt(path, "truncated header");
+        }
+        if (std::memcmp(header, kDeltaMagic, 8) == 0) {
+            uint8_t frame[kFrameHeaderSize];
+            if (fd_.read_full(frame, sizeof(frame)) != sizeof(frame)) {
+                throw corrupt(path, "bad frame header");
+            }
+            if (const char* why = parse_frame_header(frame, &cap_)) throw corrupt(path, why);
+            packed_ = arena.allocate_array<uint8_t>(cap_);
+        } else if (std::memcmp(header, kDeltaMagicV1, 8) == 0) {
+            cap_ = capacity;
+        } else {
+            throw corrupt(path, "bad magic");
+        }
+        buf_ = arena.allocate_array<uint8_t>(cap_);
+
+        header_.new_size = get_le64(header + 8);
+        header_.base_size = get_le64(header + 16);
+        std::memcpy(header_.new_digest.data(), header + 24, header_.new_digest.size());
+    }
+
+    const DeltaHeader& header() const { return header_; }
+
+    // 返回最多 want 字节的已缓冲数据, 缓冲为空时先从文件读取
+    const uint8_t* view(uint64_t want, size_t* got) {
+        if (pos_ == len_) refill();
+        *got = size_t(std::min<uint64_t>(want, len_ - pos_));
+        return buf_ + pos_;
+    }
+
+    void consume(size_t n) { pos_ += n; }
+
+    void read_exact(void* dst, size_t n) {
+        uint8_t* d = static_cast<uint8_t*>(dst);
+        while (n > 0) {
+            size_t got = 0;
+            const uint8_t* src = view(n, &got);
+            std::memcpy(d, src, got);
+            consume(got);
+            d += got;
+            n -= got;
+        }
+    }
+
+    bool at_eof() {
+        if (pos_ < len_) return false;
+        fill();
+        if (len_ > 0) return false;
+        uint8_t b;
+        if (packed_ && fd_.read_full(&b, 1) != 0) throw corrupt(fd_.path(), "data after end marker");
+        return true;
+    }
+
+private:
+    void fill() {
+        pos_ = 0;
+        len_ = 0;
+        if (!packed_) {
+            TraceSpan span(Stage::Read);
+            len_ = fd_.read_full(buf_, cap_);
+            span.add_bytes(len_);
+            return;
+        }
+        if (frame_end_) return;
+
+        uint8_t hdr[kChunkHeaderSize];
+        ChunkHeader h;
+        {
+            TraceSpan span(Stage::Read);
+            if (fd_.read_full(hdr, sizeof(hdr)) != sizeof(hdr)) {
+                throw corrupt(fd_.path(), "unexpected end of file");
+            }
+            if (const char* why = parse_chunk_header(hdr, cap_, &h)) throw corrupt(fd_.path(), why);
+            if (h.raw_len == 0) {
+                frame_end_ = true;
+                return;
+            }
+            // 未压缩的块直接读入窗口
+            uint8_t* dst = h.stored ? buf_ : packed_;
+            if (fd_.read_full(dst, h.payload_len) != h.payload_len) {
+                throw corrupt(fd_.path(), "unexpected end of file");
+            }
+            span.add_bytes(kChunkHeaderSize + h.payload_len);
+        }
+        if (!h.stored) {
+            TraceSpan span(Stage::Decompress, h.raw_len);
+            if (!decode_chunk(h, packed_, buf_)) {
+                throw corrupt(fd_.path(), "record chunk does not decode");
+            }
+        }
+        len_ = h.raw_len;
+    }
+
+    void refill() {
+        fill();
+        if (len_ == 0) throw corrupt(fd_.path(), "unexpected end of file");
+    }
+
+    FileDescriptor fd_;
+    DeltaHeader header_;
+    uint8_t* packed_ = nullptr;  // 仅 OTADLT02
+    uint8_t* buf_ = nullptr;
+    size_t cap_ = 0;
+    size_t pos_ = 0;
+    size_t len_ = 0;
+    bool frame_end_ = false;
+};
+
+// 输出经 BlockWriter 按块写出, 每块填满后整块计入摘要。
+// 有日志时记录每块的 CRC, 并在写出端 fdatasync 之后批量置位完成块。
+// 填充一块的耗时 (扣除其中读补丁的时间) 计为 patch 阶段。
+class BlockSink {
+public:
+    BlockSink(const std::string& path, Arena& arena, const WriterOptions& opts, uint64_t start,
+              const Sha256& prefix, Journal* journal)
+        : writer_(path, opts, start, &arena),
+          sha_(prefix),
+          journal_(journal),
+          block_size_(opts.buffer_size),
+          pos_(start) {}
+
+    uint8_t* space(size_t* avail) {
+        if (!patch_span_.active()) patch_span_.begin(Stage::Patch);
+        cur_ = writer_.space(avail);
+        if (!block_) block_ = cur_;
+        return cur_;
+    }
+
+    void commit(size_t n) {
+        pos_ += n;
+        block_len_ += n;
+        patch_span_.add_bytes(n);
+        // 写出缓冲区与块等长且起点对齐, 块满即缓冲区满, 须在提交之前计算
+        if (pos_ % block_size_ == 0) {
+            patch_span_.end();
+            seal_block();
+        }
+        writer_.commit(n);
+        if (journal_) journal_->mark_complete(writer_.durable_offset() / block_size_);
+    }
+
+    Digest finish() {
+        patch_span_.end();
+        seal_block();
+        writer_.finish();
+        return sha_.finish();
+    }
+
+    const BlockWriter& writer() const { return writer_; }
+
+private:
+    void seal_block() {
+        if (block_len_ == 0) return;
+        TraceSpan span(Stage::Verify, block_len_);
+        sha_.update(block_, block_len_);
+        if (journal_) {
+            journal_->set_checksum((pos_ - 1) / block_size_, crc32c(0, block_, block_len_));
+        }
+        block_ = nullptr;
+        block_len_ = 0;
+    }
+
+    BlockWriter writer_;
+    Sha256 sha_;
+    Journal* journal_;
+    uint64_t block_size_;
+    uint64_t pos_;
+    uint8_t* cur_ = nullptr;
+    uint8_t* block_ = nullptr;  // 当前块中尚未计入摘要的起点
+    size_t block_len_ = 0;
+    TraceSpan patch_span_;
+};
+
+// 续传前校验日志中已完成的块并计入摘要, 返回可信前缀的长度。
+// 校验失败或输出文件缺失的块及其之后的块都将重写。
+uint64_t verify_prefix(const std::string& out_path, Journal& journal, uint64_t image_size,
+                       Sha256& sha) {
+    const uint64_t done = journal.first_incomplete();
+    uint64_t b = 0;
+    if (done > 0 && ::access(out_path.c_str(), F_OK) == 0) {
+        MappedFile out(out_path);
+        out.advise_sequential();
+        const uint64_t block = journal.block_size();
+        for (; b < done; ++b) {
+            const uint64_t off = b * block;
+            const uint64_t len = std::min<uint64_t>(block, image_size - off);
+            if (off + len > out.size()) break;
+            TraceSpan span(Stage::Verify, len);
+            if (crc32c(0, out.data() + off, size_t(len)) != journal.checksum(b)) break;
+            sha.update(out.data() + off, size_t(len));
+            out.release(off, len);
+        }
+    }
+    if (b < journal.block_count()) journal.clear_from(b);
+    return std::min<uint64_t>(b * journal.block_size(), image_size);
+}
+
+} // namespace
+
+DeltaDiffStats delta_diff(const std::string& base_path, const std::string& new_path,
+                          const std::string& patch_path) {
+    MappedFile base(base_path);
+    MappedFile target(new_path);
+
+    uint8_t header[kDeltaHeaderSize];
+    std::memcpy(header, kDeltaMagic, 8);
+    put_le64(header + 8, target.size());
+    put_le64(header + 16, base.size());
+    const Digest digest = Sha256::hash(target.data(), size_t(target.size()));
+    std::memcpy(header + 24, digest.data(), digest.size());
+    PatchWriter out(patch_path, header, sizeof(header));
+
+    const int64_t oldsize = int64_t(base.size());
+    const int64_t newsize = int64_t(target.size());
+    DeltaDiffStats stats;
+    if (oldsize < std::numeric_limits<int32_t>::max()) {
+        stats = diff_impl<int32_t>(base.data(), oldsize, target.data(), newsize, out);
+    } else {
+        stats = diff_impl<int64_t>(base.data(), oldsize, target.data(), newsize, out);
+    }
+    stats.patch_bytes = out.close();
+    return stats;
+}
+
+DeltaApplyStats delta_apply(const std::string& base_path, const std::string& patch_path,
+                            const std::string& out_path, const DeltaApplyOptions& opts) {
+    const MappedFile file(base_path);
+    MappedBase base(file);
+    return delta_apply(base, patch_path, out_path, opts);
+}
+
+DeltaApplyStats delta_apply(BaseReader& base, const std::string& patch_path,
+                            const std::string& out_path, const DeltaApplyOptions& opts) {
+    Arena arena(opts.mem_limit);
+    return delta_apply(base, patch_path, out_path, opts, arena);
+}
+
+DeltaApplyStats delta_apply(BaseReader& base, const std::string& patch_path,
+                            const std::string& out_path, const DeltaApplyOptions& opts,
+                            Arena& arena) {
+    if (opts.block_size == 0) throw std::invalid_argument("block size must be non-zero");
+    // 输出块同时是写出缓冲区与日志块, 按 O_DIRECT 要求对齐
+    const size_t block_size = (opts.block_size + kDirectAlign - 1) / kDirectAlign * kDirectAlign;
+
+    arena.reset();
+    PatchReader patch(patch_path, arena, block_size);
+    const DeltaHeader& hdr = patch.header();
+    if (hdr.base_size != base.size()) {
+        throw std::runtime_error("base image " + base.name() + " does not match patch (size " +
+                                 std::to_string(base.size()) + ", expected " +
+                                 std::to_string(hdr.base_size) + ")");
+    }
+
+    std::unique_ptr<Journal> journal;
+    Sha256 prefix;
+    uint64_t resume = 0;
+    if (!opts.journal_path.empty()) {
+        journal.reset(new Journal(opts.journal_path, uint32_t(block_size), hdr.new_size,
+                                  hdr.new_digest));
+        resume = verify_prefix(out_path, *journal, hdr.new_size, prefix);
+    }
+
+    WriterOptions writer_opts = opts.writer;
+    writer_opts.buffer_size = block_size;
+    BlockSink sink(out_path, arena, writer_opts, resume, prefix, journal.get());
+    const uint64_t oldsize = base.size();
+
+    DeltaApplyStats stats;
+    stats.resumed_from = resume;
+    uint64_t newpos = 0;
+    uint64_t outpos = 0;  // 已产出或跳过的字节数, 早于 resume 的部分只解析不写出
+    int64_t oldpos = 0;
+    while (newpos < hdr.new_size) {
+        uint8_t ctrl[kDeltaRecordSize];
+        patch.read_exact(ctrl, sizeof(ctrl));
+        const uint64_t add_len = get_le64(ctrl);
+        const uint64_t extra_len = get_le64(ctrl + 8);
+        const int64_t seek = int64_t(get_le64(ctrl + 16));
+
+        const uint64_t left = hdr.new_size - newpos;
+        if (add_len > left || extra_len > left - add_len) {
+            throw corrupt(patch_path, "record exceeds output size");
+        }
+        if (oldpos < 0 || add_len > oldsize || uint64_t(oldpos) > oldsize - add_len) {
+            throw corrupt(patch_path, "record reads outside base image");
+        }
+
+        // diff 段: out = diff + base
+        uint64_t remaining = add_len;
+        while (remaining > 0) {
+            size_t got = 0, avail = 0, ref_len = 0;
+            const uint8_t* src = patch.view(remaining, &got);
+            size_t n;
+            if (outpos < resume) {
+                n = size_t(std::min<uint64_t>(got, resume - outpos));
+            } else {
+                const uint8_t* ref = base.view(uint64_t(oldpos), &ref_len);
+                uint8_t* dst = sink.space(&avail);
+                n = std::min(std::min(got, avail), ref_len);
+                for (size_t i = 0; i < n; ++i) dst[i] = uint8_t(src[i] + ref[i]);
+                sink.commit(n);
+            }
+            patch.consume(n);
+            oldpos += int64_t(n);
+            outpos += n;
+            remaining -= n;
+        }
+
+        // extra 段: 原样复制
+        remaining = extra_len;
+        while (remaining > 0) {
+            size_t got = 0, avail = 0;
+            const uint8_t* src = patch.view(remaining, &got);
+            size_t n;
+            if (outpos < resume) {
+                n = size_t(std::min<uint64_t>(got, resume - outpos));
+            } else {
+                uint8_t* dst = sink.space(&avail);
+                n = std::min(got, avail);
+                std::memcpy(dst, src, n);
+                sink.commit(n);
+            }
+            patch.consume(n);
+            outpos += n;
+            remaining -= n;
+        }
+
+        newpos += add_len + extra_len;
+        oldpos += seek;
+        ++stats.records;
+    }
+
+    if (!patch.at_eof()) throw corrupt(patch_path, "trailing data after last record");
+
+    // 末尾的块不再置位: 摘要通过后日志直接删除, 不通过时整个输出都不可信,
+    // 清空日志使重试从头开始, 否则每次续传都停在末尾并得到同样的错误摘要
+    const Digest digest = sink.finish();
+    if (digest != hdr.new_digest) {
+        if (journal) journal->clear_from(0);
+        throw std::runtime_error("output digest mismatch: got " + to_hex(digest) + ", expected " +
+                                 to_hex(hdr.new_digest));
+    }
+    if (journal) journal->remove();
+
+    stats.new_size = hdr.new_size;
+    stats.peak_mem = arena.peak();
+    stats.writer_backend = sink.writer().backend_name();
+    stats.direct = sink.writer().direct();
+    return stats;
+}
+
+} // namespace ota
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "block_writer.h"
+#include "mapped_file.h"
+#include "sha256.h"
+
+namespace ota {
+
+class Arena;
+
+// 补丁格式 (小端):
+//   header:  magic "OTADLT02" | new_size u64 | base_size u64 | new_sha256[32]
+//   body:    记录流, 以 kDeltaChunkSize 分块压缩为 OTALZ401 帧 (见 pipeline.h)
+//   records: add_len u64 | extra_len u64 | seek i64 | diff[add_len] | extra[extra_len]
+// 与 bsdiff 的控制三元组语义相同, 但 diff/extra 数据紧跟各自的控制记录,
+// 解码端逐块解压即可顺序输出, 无需缓存整段数据。diff 数据以 0 为主, 压缩效果明显。
+// 仍可读取记录流未压缩的 OTADLT01 补丁。
+const char kDeltaMagic[8] = {'O', 'T', 'A', 'D', 'L', 'T', '0', '2'};
+const char kDeltaMagicV1[8] = {'O', 'T', 'A', 'D', 'L', 'T', '0', '1'};
+const size_t kDeltaHeaderSize = 8 + 8 + 8 + 32;
+const size_t kDeltaRecordSize = 24;
+const size_t kDeltaChunkSize = 256u << 10;
+
+struct DeltaHeader {
+    uint64_t new_size = 0;
+    uint64_t base_size = 0;
+    Digest new_digest{};
+};
+
+struct DeltaDiffStats {
+    uint64_t records = 0;
+    uint64_t diff_bytes = 0;
+    uint64_t extra_bytes = 0;
+    uint64_t patch_bytes = 0;  // 压缩后的补丁文件大小
+};
+
+// 基于后缀数组 (qsufsort) 生成补丁; 运行在构建机上, 内存约为 base 的 4~8 倍
+DeltaDiffStats delta_diff(const std::string& base_path, const std::string& new_path,
+                          const std::string& patch_path);
+
+struct DeltaApplyOptions {
+    size_t block_size = 1u << 20;  // 输出块 (写出缓冲区与日志块) 大小, 凑满即写出
+    size_t mem_limit = 64u << 20;  // 解码期间所有缓冲区 (含写出队列) 的总上限
+    WriterOptions writer;          // buffer_size 由 block_size 决定
+    std::string journal_path;      // 非空时启用断点续传日志
+};
+
+struct DeltaApplyStats {
+    uint64_t new_size = 0;
+    uint64_t records = 0;
+    size_t peak_mem = 0;
+    uint64_t resumed_from = 0;  // 续传起点, 0 表示从头开始
+    const char* writer_backend = "";
+    bool direct = false;
+};
+
+// 应用补丁时对基础镜像的只读访问, 实现可以按块解码并缓存
+class BaseReader {
+public:
+    virtual ~BaseReader() {}
+    virtual uint64_t size() const = 0;
+    virtual const std::string& name() const = 0;
+    // 返回自 offset (< size()) 起的一段连续数据, 可用长度写入 *len (至少 1 字节)。
+    // 指针在下一次调用 view 之前有效
+    virtual const uint8_t* view(uint64_t offset, size_t* len) = 0;
+};
+
+// mmap 的原始镜像, 一次即可返回全部剩余数据
+class MappedBase : public BaseReader {
+public:
+    explicit MappedBase(const MappedFile& file) : file_(file) {}
+
+    uint64_t size() const override { return file_.size(); }
+    const std::string& name() const override { return file_.path(); }
+    const uint8_t* view(uint64_t offset, size_t* len) override {
+        *len = size_t(file_.size() - offset);
+        return file_.data() + offset;
+    }
+
+private:
+    const MappedFile& file_;
+};
+
+// 流式应用补丁: 补丁与输出均经定长缓冲区处理
+DeltaApplyStats delta_apply(BaseReader& base, const std::string& patch_path,
+                            const std::string& out_path, const DeltaApplyOptions& opts);
+
+// 同上, 所有缓冲区 (补丁窗口与写出队列) 取自调用方的 arena, 开始前先 reset;
+// 上限为 arena 的容量, opts.mem_limit 不再使用。批量执行时每个线程复用同一 arena
+DeltaApplyStats delta_apply(BaseReader& base, const std::string& patch_path,
+                            const std::string& out_path, const DeltaApplyOptions& opts,
+                            Arena& arena);
+
+// 同上, base 为原始镜像文件, 通过 mmap 访问
+DeltaApplyStats delta_apply(const std::string& base_path, const std::string& patch_path,
+                            const std::string& out_path, const DeltaApplyOptions& opts);
+
+} // namespace ota
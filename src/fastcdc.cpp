@@ -0,0 +1,68 @@
+#include "fastcdc.h"
+
+#include <stdexcept>
+
+namespace ota {
+
+namespace {
+
+// 固定种子的 splitmix64 生成 gear 表, 保证不同版本/机器上切点一致
+struct GearTable {
+    uint64_t g[256];
+    GearTable() {
+        uint64_t x = 0x6f7461636463ull;  // "otacdc"
+        for (int i = 0; i < 256; ++i) {
+            uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            g[i] = z ^ (z >> 31);
+        }
+    }
+};
+
+const GearTable kGear;
+
+// gear 哈希的第 k 位只受最近 k+1 个字节影响, 因此掩码取高位以覆盖完整窗口
+uint64_t high_mask(unsigned bits) { return bits == 0 ? 0 : ~uint64_t(0) << (64 - bits); }
+
+unsigned log2_exact(size_t v) {
+    unsigned b = 0;
+    while ((size_t(1) << b) < v) ++b;
+    return b;
+}
+
+} // namespace
+
+FastCdc::FastCdc(const CdcParams& params) : params_(params) {
+    const size_t avg = params.avg_size;
+    if (avg < 64 || (avg & (avg - 1)) != 0) {
+        throw std::invalid_argument("average chunk size must be a power of two >= 64");
+    }
+    if (params.min_size > avg || avg > params.max_size) {
+        throw std::invalid_argument("chunk sizes must satisfy min <= avg <= max");
+    }
+    const unsigned bits = log2_exact(avg);
+    mask_s_ = high_mask(bits + 1);
+    mask_l_ = high_mask(bits - 1);
+}
+
+size_t FastCdc::next_cut(const uint8_t* p, size_t n) const {
+    if (n <= params_.min_size) return n;
+    if (n > params_.max_size) n = params_.max_size;
+    const size_t normal = n < params_.avg_size ? n : params_.avg_size;
+
+    const uint64_t* gear = kGear.g;
+    uint64_t h = 0;
+    size_t i = params_.min_size;
+    for (; i < normal; ++i) {
+        h = (h << 1) + gear[p[i]];
+        if ((h & mask_s_) == 0) return i + 1;
+    }
+    for (; i < n; ++i) {
+        h = (h << 1) + gear[p[i]];
+        if ((h & mask_l_) == 0) return i + 1;
+    }
+    return n;
+}
+
+} // namespace ota
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ota {
+
+struct CdcParams {
+    size_t min_size = 16u << 10;
+    size_t avg_size = 64u << 10;  // 须为 2 的幂
+    size_t max_size = 256u << 10;
+};
+
+// FastCDC 内容定义分块: gear 滚动哈希 + 归一化分块 (平均长度前后使用不同掩码)。
+// 切点只取决于附近内容, 镜像局部改动只影响相邻的少数块。
+class FastCdc {
+public:
+    explicit FastCdc(const CdcParams& params = CdcParams());
+
+    // 返回从 p 开始的下一个块的长度 (不超过 n)
+    size_t next_cut(const uint8_t* p, size_t n) const;
+
+    const CdcParams& params() const { return params_; }
+
+private:
+    CdcParams params_;
+    uint64_t mask_s_;  // 平均长度之前: 更多位, 切点更难出现
+    uint64_t mask_l_;  // 平均长度之后: 更少位, 切点更易出现
+};
+
+} // namespace ota
@@ -0,0 +1,56 @@
+#include "file_io.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace ota {
+
+std::runtime_error io_error(const std::string& what, const std::string& path) {
+    return std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+}
+
+FileDescriptor::FileDescriptor(const std::string& path, int flags, mode_t mode) : path_(path) {
+    fd_ = ::open(path.c_str(), flags | O_CLOEXEC, mode);
+    if (fd_ < 0) throw io_error("cannot open", path);
+}
+
+FileDescriptor::~FileDescriptor() {
+    if (fd_ >= 0) ::close(fd_);
+}
+
+size_t FileDescriptor::read_full(void* buf, size_t len) {
+    uint8_t* p = static_cast<uint8_t*>(buf);
+    size_t done = 0;
+    while (done < len) {
+        const ssize_t r = ::read(fd_, p + done, len - done);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            throw io_error("cannot read", path_);
+        }
+        if (r == 0) break;
+        done += size_t(r);
+    }
+    return done;
+}
+
+void FileDescriptor::write_full(const void* buf, size_t len) {
+    const uint8_t* p = static_cast<const uint8_t*>(buf);
+    size_t done = 0;
+    while (done < len) {
+        const ssize_t w = ::write(fd_, p + done, len - done);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            throw io_error("cannot write", path_);
+        }
+        done += size_t(w);
+    }
+}
+
+void FileDescriptor::sync() {
+    if (::fsync(fd_) != 0) throw io_error("cannot sync", path_);
+}
+
+} // namespace ota
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#include <sys/types.h>
+
+namespace ota {
+
+// 以 errno 描述构造异常
+std::runtime_error io_error(const std::string& what, const std::string& path);
+
+// 文件描述符 RAII 包装, 打开失败抛异常
+class FileDescriptor {
+public:
+    FileDescriptor(const std::string& path, int flags, mode_t mode = 0644);
+    ~FileDescriptor();
+
+    FileDescriptor(const FileDescriptor&) = delete;
+    FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+    int get() const { return fd_; }
+    const std::string& path() const { return path_; }
+
+    // 读取直到填满 len 或遇到 EOF, 返回实际字节数
+    size_t read_full(void* buf, size_t len);
+    // 写出全部 len 字节
+    void write_full(const void* buf, size_t len);
+    void sync();
+
+private:
+    std::string path_;
+    int fd_;
+};
+
+inline void put_le32(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; ++i) p[i] = uint8_t(v >> (8 * i));
+}
+
+inline uint32_t get_le32(const uint8_t* p) {
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+inline void put_le64(uint8_t* p, uint64_t v) {
+    for (int i = 0; i < 8; ++i) p[i] = uint8_t(v >> (8 * i));
+}
+
+inline uint64_t get_le64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) v |= uint64_t(p[i]) << (8 * i);
+    return v;
+}
+
+} // namespace ota
@@ -0,0 +1,108 @@
+#include "journal.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "file_io.h"
+
+namespace ota {
+
+namespace {
+
+const char kJournalMagic[8] = {'O', 'T', 'A', 'J', 'N', 'L', '0', '1'};
+const size_t kJournalHeaderSize = 64;
+
+} // namespace
+
+Journal::Journal(const std::string& path, uint32_t block_size, uint64_t image_size,
+                 const Digest& image_digest)
+    : path_(path), block_size_(block_size) {
+    if (block_size == 0) throw std::invalid_argument("journal block size must be non-zero");
+    block_count_ = (image_size + block_size - 1) / block_size;
+    const uint64_t words = (block_count_ + 63) / 64;
+    map_size_ = size_t(kJournalHeaderSize + words * 8 + block_count_ * 4);
+
+    FileDescriptor fd(path, O_RDWR | O_CREAT);
+    struct stat st;
+    if (::fstat(fd.get(), &st) != 0) throw io_error("cannot stat", path);
+
+    uint8_t header[kJournalHeaderSize] = {};
+    std::memcpy(header, kJournalMagic, 8);
+    put_le32(header + 8, block_size);
+    put_le64(header + 16, block_count_);
+    put_le64(header + 24, image_size);
+    std::memcpy(header + 32, image_digest.data(), image_digest.size());
+
+    const bool same_size = uint64_t(st.st_size) == map_size_;
+    if (!same_size) {
+        // 新日志或属于其它镜像: 重建为全零 (无已完成块)
+        if (::ftruncate(fd.get(), 0) != 0 || ::ftruncate(fd.get(), off_t(map_size_)) != 0) {
+            throw io_error("cannot size", path);
+        }
+    }
+
+    void* p = ::mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd.get(), 0);
+    if (p == MAP_FAILED) throw io_error("cannot mmap", path);
+    map_ = static_cast<uint8_t*>(p);
+    bitmap_ = reinterpret_cast<uint64_t*>(map_ + kJournalHeaderSize);
+    checksums_ = reinterpret_cast<uint32_t*>(map_ + kJournalHeaderSize + words * 8);
+
+    if (same_size && std::memcmp(map_, header, sizeof(header)) == 0) {
+        resumed_ = true;
+        marked_ = first_incomplete();
+    } else {
+        std::memset(map_, 0, map_size_);
+        std::memcpy(map_, header, sizeof(header));
+        sync();
+    }
+}
+
+Journal::~Journal() {
+    if (map_) ::munmap(map_, map_size_);
+}
+
+bool Journal::is_complete(uint64_t block) const {
+    return (bitmap_[block / 64] >> (block % 64)) & 1;
+}
+
+uint64_t Journal::first_incomplete() const {
+    const uint64_t words = (block_count_ + 63) / 64;
+    for (uint64_t w = 0; w < words; ++w) {
+        if (bitmap_[w] != ~uint64_t(0)) {
+            const uint64_t block = w * 64 + uint64_t(__builtin_ctzll(~bitmap_[w]));
+            return block < block_count_ ? block : block_count_;
+        }
+    }
+    return block_count_;
+}
+
+void Journal::mark_complete(uint64_t end_block) {
+    if (end_block > block_count_) end_block = block_count_;
+    if (end_block <= marked_) return;
+    for (uint64_t b = marked_; b < end_block; ++b) bitmap_[b / 64] |= uint64_t(1) << (b % 64);
+    marked_ = end_block;
+    sync();
+}
+
+void Journal::clear_from(uint64_t block) {
+    for (uint64_t b = block; b < block_count_; ++b) bitmap_[b / 64] &= ~(uint64_t(1) << (b % 64));
+    if (marked_ > block) marked_ = block;
+    sync();
+}
+
+void Journal::sync() {
+    if (::msync(map_, map_size_, MS_SYNC) != 0) throw io_error("cannot sync", path_);
+}
+
+void Journal::remove() {
+    if (map_) ::munmap(map_, map_size_);
+    map_ = nullptr;
+    if (::unlink(path_.c_str()) != 0) throw io_error("cannot remove", path_);
+}
+
+} // namespace ota
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "sha256.h"
+
+namespace ota {
+
+// 断点续传日志, 整个文件 mmap 使用, 无需反序列化:
+//   header (64B): magic "OTAJNL01" | block_size u32 | reserved u32 | block_count u64
+//                 | image_size u64 | image_sha256[32]
+//   bitmap:       ceil(block_count / 64) 个 u64, 第 i 位表示块 i 已落盘
+//   checksums:    block_count 个 u32 (块内容的 CRC-32C)
+// 位只在对应数据 fdatasync 之后才置位, 因此置位的块一定完整。
+class Journal {
+public:
+    // 打开已有日志; 若不存在或与目标镜像不匹配则新建
+    Journal(const std::string& path, uint32_t block_size, uint64_t image_size,
+            const Digest& image_digest);
+    ~Journal();
+
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    uint32_t block_size() const { return block_size_; }
+    uint64_t block_count() const { return block_count_; }
+    bool resumed() const { return resumed_; }
+
+    bool is_complete(uint64_t block) const;
+    // 第一个未完成块的序号, 全部完成时返回 block_count
+    uint64_t first_incomplete() const;
+
+    uint32_t checksum(uint64_t block) const { return checksums_[block]; }
+    void set_checksum(uint64_t block, uint32_t crc) { checksums_[block] = crc; }
+
+    // 将 [0, end_block) 标记为完成并持久化; 调用方保证这些块的数据已落盘
+    void mark_complete(uint64_t end_block);
+    // 清除 block 及之后的完成位 (校验失败时回退)
+    void clear_from(uint64_t block);
+
+    void sync();
+    // 应用成功后删除日志
+    void remove();
+
+private:
+    void create(int fd);
+
+    std::string path_;
+    uint32_t block_size_;
+    uint64_t block_count_;
+    uint64_t marked_ = 0;
+    bool resumed_ = false;
+
+    uint8_t* map_ = nullptr;
+    size_t map_size_ = 0;
+    uint64_t* bitmap_ = nullptr;
+    uint32_t* checksums_ = nullptr;
+};
+
+} // namespace ota
@@ -0,0 +1,160 @@
+#include "lz4_block.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace ota {
+
+namespace {
+
+const size_t kMinMatch = 4;
+const size_t kLastLiterals = 5;   // 块末尾至少 5 字节为字面量
+const size_t kMfLimit = 12;       // 最后一个匹配须在距末尾 12 字节之前开始
+const size_t kMaxOffset = 65535;
+const int kHashLog = 14;
+
+inline uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+inline uint32_t hash4(uint32_t v) { return (v * 2654435761u) >> (32 - kHashLog); }
+
+// 写入 LZ4 变长长度的扩展字节 (len 已减去 15)
+inline uint8_t* put_length(uint8_t* op, size_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = uint8_t(len);
+    return op;
+}
+
+} // namespace
+
+size_t lz4_compress(const uint8_t* src, size_t src_len, uint8_t* dst, size_t dst_cap) {
+    uint8_t* op = dst;
+    uint8_t* const op_end = dst + dst_cap;
+    size_t anchor = 0;
+
+    // 输出一个序列; offset == 0 表示末尾的纯字面量序列
+    auto emit = [&](size_t lit_end, size_t offset, size_t match_len) -> bool {
+        const size_t lit = lit_end - anchor;
+        const size_t need = 1 + lit / 255 + 1 + lit + (offset ? 2 + match_len / 255 + 1 : 0);
+        if (need > size_t(op_end - op)) return false;
+
+        uint8_t* token = op++;
+        *token = uint8_t((lit >= 15 ? 15 : lit) << 4);
+        if (lit >= 15) op = put_length(op, lit - 15);
+        std::memcpy(op, src + anchor, lit);
+        op += lit;
+        if (offset) {
+            *op++ = uint8_t(offset);
+            *op++ = uint8_t(offset >> 8);
+            const size_t ml = match_len - kMinMatch;
+            *token |= uint8_t(ml >= 15 ? 15 : ml);
+            if (ml >= 15) op = put_length(op, ml - 15);
+        }
+        return true;
+    };
+
+    if (src_len > kMfLimit) {
+        uint32_t table[1 << kHashLog];
+        std::memset(table, 0, sizeof(table));
+
+        const size_t mflimit = src_len - kMfLimit;
+        const size_t matchlimit = src_len - kLastLiterals;
+        size_t ip = 0;
+        while (ip < mflimit) {
+            const uint32_t seq = read32(src + ip);
+            const uint32_t h = hash4(seq);
+            size_t cand = table[h];
+            table[h] = uint32_t(ip);
+
+            if (cand >= ip || ip - cand > kMaxOffset || read32(src + cand) != seq) {
+                // 未命中: 连续失败越多步长越大, 快速跳过不可压缩数据
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+
+            while (ip > anchor && cand > 0 && src[ip - 1] == src[cand - 1]) {
+                --ip;
+                --cand;
+            }
+            size_t len = kMinMatch;
+            while (ip + len < matchlimit && src[ip + len] == src[cand + len]) ++len;
+
+            if (!emit(ip, ip - cand, len)) return 0;
+            ip += len;
+            anchor = ip;
+            if (ip - 2 < mflimit) table[hash4(read32(src + ip - 2))] = uint32_t(ip - 2);
+        }
+    }
+
+    if (!emit(src_len, 0, 0)) return 0;
+    return size_t(op - dst);
+}
+
+size_t lz4_decompress(const uint8_t* src, size_t src_len, uint8_t* dst, size_t dst_cap) {
+    const size_t kError = SIZE_MAX;
+    size_t ip = 0;
+    size_t op = 0;
+
+    while (ip < src_len) {
+        const uint8_t token = src[ip++];
+
+        size_t lit = token >> 4;
+        if (lit == 15) {
+            uint8_t b;
+            do {
+                if (ip >= src_len) return kError;
+                b = src[ip++];
+                lit += b;
+            } while (b == 255);
+        }
+        if (lit > src_len - ip || lit > dst_cap - op) return kError;
+        std::memcpy(dst + op, src + ip, lit);
+        ip += lit;
+        op += lit;
+
+        if (ip == src_len) return op;  // 最后一个序列只有字面量
+
+        if (src_len - ip < 2) return kError;
+        const size_t offset = size_t(src[ip]) | (size_t(src[ip + 1]) << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) return kError;
+
+        size_t len = token & 15;
+        if (len == 15) {
+            uint8_t b;
+            do {
+                if (ip >= src_len) return kError;
+                b = src[ip++];
+                len += b;
+            } while (b == 255);
+        }
+        len += kMinMatch;
+        if (len > dst_cap - op) return kError;
+
+        uint8_t* d = dst + op;
+        const uint8_t* m = d - offset;
+        if (offset >= len) {
+            std::memcpy(d, m, len);
+        } else {
+            // 重叠复制 (如 offset 1 的游程): 已写出部分是以 offset 为周期的模式,
+            // 每次从 m 复制不重叠的整周期段, 段长逐次翻倍
+            size_t copied = 0;
+            while (copied < len) {
+                const size_t n = std::min(len - copied, copied + offset);
+                std::memcpy(d + copied, m, n);
+                copied += n;
+            }
+        }
+        op += len;
+    }
+    return kError;
+}
+
+} // namespace ota
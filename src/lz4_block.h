@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ota {
+
+// LZ4 块格式 (与 liblz4 的 LZ4_compress_default / LZ4_decompress_safe 互通)。
+// 不依赖外部库, 仅实现单块压缩/解压; 分块与帧格式见 pipeline.h。
+
+// 压缩 src 到 dst, 输出超过 dst_cap 时返回 0 (调用方应改为原样存储)
+size_t lz4_compress(const uint8_t* src, size_t src_len, uint8_t* dst, size_t dst_cap);
+
+// 解压到 dst, 数据损坏或超出 dst_cap 时返回 SIZE_MAX
+size_t lz4_decompress(const uint8_t* src, size_t src_len, uint8_t* dst, size_t dst_cap);
+
+} // namespace ota
@@ -0,0 +1,106 @@
+#include "mapped_file.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ota {
+
+namespace {
+
+uint64_t page_size() {
+    static const uint64_t ps = uint64_t(sysconf(_SC_PAGESIZE));
+    return ps;
+}
+
+std::runtime_error sys_error(const std::string& what, const std::string& path) {
+    return std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+}
+
+} // namespace
+
+MappedFile::MappedFile(const std::string& path) : path_(path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) throw sys_error("cannot open", path);
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw sys_error("cannot stat", path);
+    }
+    size_ = uint64_t(st.st_size);
+    // 块设备 (分区) 的 st_size 为 0, 大小须向设备查询
+    if (S_ISBLK(st.st_mode) && ::ioctl(fd, BLKGETSIZE64, &size_) != 0) {
+        ::close(fd);
+        throw sys_error("cannot get size of", path);
+    }
+
+    if (size_ > 0) {
+        void* p = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            ::close(fd);
+            throw sys_error("cannot mmap", path);
+        }
+        data_ = static_cast<uint8_t*>(p);
+    }
+    // 映射建立后即可关闭描述符
+    ::close(fd);
+}
+
+MappedFile::~MappedFile() { close(); }
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : path_(std::move(other.path_)), data_(other.data_), size_(other.size_) {
+    other.data_ = nullptr;
+    other.size_ = 0;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        close();
+        path_ = std::move(other.path_);
+        data_ = other.data_;
+        size_ = other.size_;
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+void MappedFile::close() {
+    if (data_) ::munmap(data_, size_);
+    data_ = nullptr;
+    size_ = 0;
+}
+
+void MappedFile::advise_sequential() const {
+    if (data_) ::madvise(data_, size_, MADV_SEQUENTIAL);
+}
+
+void MappedFile::prefetch(uint64_t offset, uint64_t len) const {
+    if (!data_ || offset >= size_) return;
+    if (len > size_ - offset) len = size_ - offset;
+    const uint64_t start = offset & ~(page_size() - 1);
+    ::madvise(data_ + start, len + (offset - start), MADV_WILLNEED);
+}
+
+void MappedFile::release(uint64_t offset, uint64_t len) const {
+    if (!data_ || offset >= size_) return;
+    if (len > size_ - offset) len = size_ - offset;
+    // 只释放完整落在区间内的页, 避免丢掉相邻块仍要用的页
+    const uint64_t ps = page_size();
+    const uint64_t start = (offset + ps - 1) & ~(ps - 1);
+    const uint64_t end = (offset + len == size_) ? offset + len : ((offset + len) & ~(ps - 1));
+    if (end <= start) return;
+    ::madvise(data_ + start, end - start, MADV_DONTNEED);
+}
+
+} // namespace ota
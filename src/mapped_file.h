@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace ota {
+
+// 只读内存映射文件。大镜像只占用虚拟地址空间, 按块处理后可调用 release() 归还物理页。
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    const uint8_t* data() const { return data_; }
+    uint64_t size() const { return size_; }
+    const std::string& path() const { return path_; }
+
+    // 顺序访问提示, 内核会加大预读窗口
+    void advise_sequential() const;
+    // 预取 [offset, offset + len)
+    void prefetch(uint64_t offset, uint64_t len) const;
+    // 丢弃 [offset, offset + len) 在本进程中的驻留页, 保持 RSS 恒定
+    void release(uint64_t offset, uint64_t len) const;
+
+private:
+    void close();
+
+    std::string path_;
+    uint8_t* data_ = nullptr;
+    uint64_t size_ = 0;
+};
+
+} // namespace ota
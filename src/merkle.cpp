@@ -0,0 +1,241 @@
+#include "merkle.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "file_io.h"
+#include "trace.h"
+#include "work_stealing.h"
+
+namespace ota {
+
+namespace {
+
+const uint8_t kLeafTag = 0x00;
+const uint8_t kNodeTag = 0x01;
+const uint64_t kLeafTaskBytes = 4u << 20;  // 每个叶子任务至少覆盖这么多镜像数据
+const uint64_t kNodeGrain = 4096;
+
+std::runtime_error corrupt(const std::string& path, const std::string& why) {
+    return std::runtime_error("corrupt manifest " + path + ": " + why);
+}
+
+void leaf_hash(const uint8_t* data, size_t len, uint8_t* out) {
+    Sha256 sha;
+    sha.update(&kLeafTag, 1);
+    if (len > 0) sha.update(data, len);
+    const Digest d = sha.finish();
+    std::memcpy(out, d.data(), d.size());
+}
+
+void node_hash(const uint8_t* left, const uint8_t* right, uint8_t* out) {
+    Sha256 sha;
+    sha.update(&kNodeTag, 1);
+    sha.update(left, 32);
+    sha.update(right, 32);
+    const Digest d = sha.finish();
+    std::memcpy(out, d.data(), d.size());
+}
+
+uint64_t leaf_len(uint64_t image_size, uint32_t block_size, uint64_t leaf) {
+    const uint64_t off = leaf * block_size;
+    return off < image_size ? std::min<uint64_t>(block_size, image_size - off) : 0;
+}
+
+// 各层节点数, 自叶子层起, 最后一层为 1
+std::vector<uint64_t> level_sizes(uint64_t leaf_count) {
+    std::vector<uint64_t> sizes(1, leaf_count);
+    while (sizes.back() > 1) sizes.push_back((sizes.back() + 1) / 2);
+    return sizes;
+}
+
+// 由下一层计算 [begin, end) 号父节点; 落单的最后一个子节点原样上提
+void hash_parents(const uint8_t* below, uint64_t below_size, uint8_t* above, uint64_t begin,
+                  uint64_t end) {
+    for (uint64_t i = begin; i < end; ++i) {
+        if (2 * i + 1 < below_size) {
+            node_hash(below + 2 * i * 32, below + (2 * i + 1) * 32, above + i * 32);
+        } else {
+            std::memcpy(above + i * 32, below + 2 * i * 32, 32);
+        }
+    }
+}
+
+struct Unmapper {
+    void* addr;
+    size_t size;
+    ~Unmapper() { ::munmap(addr, size); }
+};
+
+} // namespace
+
+ManifestStats build_manifest(const std::string& image_path, const std::string& manifest_path,
+                             uint32_t block_size, unsigned threads) {
+    if (block_size == 0) throw std::invalid_argument("manifest block size must be non-zero");
+
+    MappedFile image(image_path);
+    ManifestStats stats;
+    stats.image_size = image.size();
+    stats.block_size = block_size;
+    stats.leaf_count = std::max<uint64_t>(1, (image.size() + block_size - 1) / block_size);
+    stats.threads = resolve_threads(threads);
+
+    const std::vector<uint64_t> sizes = level_sizes(stats.leaf_count);
+    stats.levels = uint32_t(sizes.size());
+    uint64_t nodes = 0;
+    for (uint64_t s : sizes) nodes += s;
+    const size_t map_size = size_t(kManifestHeaderSize + nodes * 32);
+
+    FileDescriptor fd(manifest_path, O_RDWR | O_CREAT | O_TRUNC);
+    if (::ftruncate(fd.get(), off_t(map_size)) != 0) throw io_error("cannot size", manifest_path);
+    void* p = ::mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd.get(), 0);
+    if (p == MAP_FAILED) throw io_error("cannot mmap", manifest_path);
+    const Unmapper unmap{p, map_size};
+    uint8_t* map = static_cast<uint8_t*>(p);
+
+    // 叶子层: 每个任务处理一段连续的块, 处理完归还镜像页
+    uint8_t* level = map + kManifestHeaderSize;
+    const uint64_t grain = std::max<uint64_t>(1, kLeafTaskBytes / block_size);
+    parallel_for(
+        stats.leaf_count, grain, stats.threads,
+        [&](uint64_t begin, uint64_t end) {
+            const uint64_t off = begin * block_size;
+            const uint64_t len = std::min(end * block_size, stats.image_size) -
+                                 std::min(off, stats.image_size);
+            TraceSpan span(Stage::Verify, len);
+            image.prefetch(off, len);
+            for (uint64_t i = begin; i < end; ++i) {
+                leaf_hash(image.data() + i * block_size,
+                          size_t(leaf_len(stats.image_size, block_size, i)), level + i * 32);
+            }
+            image.release(off, len);
+        },
+        "merkle");
+
+    for (size_t l = 1; l < sizes.size(); ++l) {
+        uint8_t* above = level + sizes[l - 1] * 32;
+        const uint64_t below_size = sizes[l - 1];
+        parallel_for(
+            sizes[l], kNodeGrain, stats.threads,
+            [&](uint64_t begin, uint64_t end) {
+                hash_parents(level, below_size, above, begin, end);
+            },
+            "merkle");
+        level = above;
+    }
+    std::memcpy(stats.root.data(), level, 32);
+
+    // 节点落盘后再写头部, 中途失败的清单因魔数缺失不会被误用
+    if (::msync(map, map_size, MS_SYNC) != 0) throw io_error("cannot sync", manifest_path);
+    std::memcpy(map, kManifestMagic, 8);
+    put_le64(map + 8, stats.image_size);
+    put_le64(map + 16, stats.leaf_count);
+    put_le32(map + 24, block_size);
+    put_le32(map + 28, stats.levels);
+    std::memcpy(map + 32, stats.root.data(), 32);
+    if (::msync(map, kManifestHeaderSize, MS_SYNC) != 0) throw io_error("cannot sync", manifest_path);
+    return stats;
+}
+
+MerkleManifest::MerkleManifest(const std::string& path) : file_(path) {
+    const uint8_t* hdr = file_.data();
+    if (file_.size() < kManifestHeaderSize || std::memcmp(hdr, kManifestMagic, 8) != 0) {
+        throw corrupt(path, "bad header");
+    }
+    image_size_ = get_le64(hdr + 8);
+    const uint64_t leaf_count = get_le64(hdr + 16);
+    block_size_ = get_le32(hdr + 24);
+    std::memcpy(root_.data(), hdr + 32, 32);
+    if (block_size_ == 0 ||
+        leaf_count != std::max<uint64_t>(1, (image_size_ + block_size_ - 1) / block_size_)) {
+        throw corrupt(path, "leaf count does not match image size");
+    }
+
+    level_size_ = level_sizes(leaf_count);
+    if (get_le32(hdr + 28) != level_size_.size()) throw corrupt(path, "bad level count");
+    uint64_t off = kManifestHeaderSize;
+    for (uint64_t s : level_size_) {
+        level_offset_.push_back(off);
+        off += s * 32;
+    }
+    if (off != file_.size()) throw corrupt(path, "size does not match header");
+    if (std::memcmp(node(uint32_t(level_size_.size() - 1), 0), root_.data(), 32) != 0) {
+        throw corrupt(path, "root node does not match header");
+    }
+}
+
+const uint8_t* MerkleManifest::node(uint32_t level, uint64_t index) const {
+    return file_.data() + level_offset_[level] + index * 32;
+}
+
+bool MerkleManifest::verify_range(uint64_t first, uint64_t count, const uint8_t* data,
+                                  uint64_t* hashes) const {
+    if (count == 0 || first >= leaf_count() || count > leaf_count() - first) {
+        throw std::invalid_argument("block range outside manifest");
+    }
+    TraceSpan span(Stage::Verify, std::min<uint64_t>(count * block_size_, image_size_));
+
+    // cur 的前后各留一个位置, 放区间两端缺少的兄弟节点
+    std::vector<uint8_t> cur((count + 2) * 32);
+    uint8_t* items = cur.data() + 32;
+    for (uint64_t i = 0; i < count; ++i) {
+        leaf_hash(data + i * block_size_, size_t(leaf_len(image_size_, block_size_, first + i)),
+                  items + i * 32);
+    }
+    uint64_t n_hashes = count;
+
+    uint64_t lo = first;
+    uint64_t len = count;
+    for (uint32_t level = 0; level + 1 < level_size_.size(); ++level) {
+        if (lo & 1) {
+            items -= 32;
+            std::memcpy(items, node(level, lo - 1), 32);
+            --lo;
+            ++len;
+        }
+        if (((lo + len) & 1) && lo + len < level_size_[level]) {
+            std::memcpy(items + len * 32, node(level, lo + len), 32);
+            ++len;
+        }
+        // lo 为偶数; len 为奇数时末尾节点是本层最后一个, 原样上提
+        const uint64_t parents = (len + 1) / 2;
+        uint8_t* out = cur.data() + 32;
+        for (uint64_t j = 0; j < parents; ++j) {
+            if (2 * j + 1 < len) {
+                node_hash(items + 2 * j * 32, items + (2 * j + 1) * 32, out + j * 32);
+                ++n_hashes;
+            } else {
+                std::memmove(out + j * 32, items + 2 * j * 32, 32);
+            }
+        }
+        items = out;
+        lo /= 2;
+        len = parents;
+    }
+
+    if (hashes) *hashes = n_hashes;
+    return std::memcmp(items, root_.data(), 32) == 0;
+}
+
+bool verify_blocks(const std::string& image_path, const MerkleManifest& manifest, uint64_t first,
+                   uint64_t count, uint64_t* hashes) {
+    MappedFile image(image_path);
+    if (image.size() != manifest.image_size()) {
+        throw std::runtime_error("image " + image_path + " size " + std::to_string(image.size()) +
+                                 " does not match manifest (" +
+                                 std::to_string(manifest.image_size()) + ")");
+    }
+    if (count == 0 || first >= manifest.leaf_count() || count > manifest.leaf_count() - first) {
+        throw std::invalid_argument("block range outside manifest");
+    }
+    const uint64_t off = first * manifest.block_size();
+    image.prefetch(off, count * manifest.block_size());
+    return manifest.verify_range(first, count, image.data() + off, hashes);
+}
+
+} // namespace ota
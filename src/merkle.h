@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+#include "sha256.h"
+
+namespace ota {
+
+// Merkle 清单 (小端), 整个文件 mmap 使用:
+//   header (64B): magic "OTAMKL01" | image_size u64 | leaf_count u64 | block_size u32 | levels u32
+//                 | root[32]
+//   nodes:        自叶子层向上逐层存放, 第 i 层 ceil(leaf_count / 2^i) 个哈希, 最后一层只有根
+// 叶子 = SHA-256(0x00 | 块数据), 内部节点 = SHA-256(0x01 | 左 | 右), 前缀区分两类节点
+// 以防互相冒充 (同 RFC 6962); 一层中落单的最后一个节点原样上提。空镜像有一个空叶子。
+const char kManifestMagic[8] = {'O', 'T', 'A', 'M', 'K', 'L', '0', '1'};
+const size_t kManifestHeaderSize = 64;
+const uint32_t kDefaultManifestBlock = 1u << 20;
+
+struct ManifestStats {
+    uint64_t image_size = 0;
+    uint64_t leaf_count = 0;
+    uint32_t block_size = 0;
+    uint32_t levels = 0;
+    unsigned threads = 0;
+    Digest root{};
+};
+
+// 为镜像生成清单。叶子由工作窃取调度的 threads 个线程并行计算 (0 = 硬件线程数)
+ManifestStats build_manifest(const std::string& image_path, const std::string& manifest_path,
+                             uint32_t block_size = kDefaultManifestBlock, unsigned threads = 0);
+
+class MerkleManifest {
+public:
+    explicit MerkleManifest(const std::string& path);
+
+    uint64_t image_size() const { return image_size_; }
+    uint64_t leaf_count() const { return level_size_[0]; }
+    uint32_t block_size() const { return block_size_; }
+    const Digest& root() const { return root_; }
+
+    // 用 [first, first + count) 块的数据 (自 data 起连续存放) 重算根并与清单中的根比较。
+    // 只读取区间两端的兄弟节点, 共 O(count + log n) 次哈希; hashes 非空时返回哈希次数
+    bool verify_range(uint64_t first, uint64_t count, const uint8_t* data,
+                      uint64_t* hashes = nullptr) const;
+
+private:
+    const uint8_t* node(uint32_t level, uint64_t index) const;
+
+    MappedFile file_;
+    uint64_t image_size_ = 0;
+    uint32_t block_size_ = 0;
+    Digest root_{};
+    std::vector<uint64_t> level_size_;
+    std::vector<uint64_t> level_offset_;
+};
+
+// 从镜像读取 [first, first + count) 块, 按清单校验
+bool verify_blocks(const std::string& image_path, const MerkleManifest& manifest, uint64_t first,
+                   uint64_t count, uint64_t* hashes = nullptr);
+
+} // namespace ota
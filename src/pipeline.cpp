@@ -0,0 +1,295 @@
+#include "pipeline.h"
+
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+
+#include "block_writer.h"
+#include "bounded_queue.h"
+#include "buffer_pool.h"
+#include "file_io.h"
+#include "lz4_block.h"
+#include "trace.h"
+#include "work_stealing.h"
+
+namespace ota {
+
+namespace {
+
+struct Job {
+    uint64_t seq = 0;
+    uint8_t* in = nullptr;
+    size_t in_len = 0;     // 仅压缩时使用
+    uint8_t* out = nullptr;
+    ChunkHeader header;
+};
+
+// 记录第一个异常并通知所有阶段退出
+class FirstError {
+public:
+    void set(std::exception_ptr e) {
+        std::lock_guard<std::mutex> lock(mu_);
+        if (!error_) error_ = e;
+        failed.store(true, std::memory_order_release);
+    }
+    void rethrow() {
+        if (error_) std::rethrow_exception(error_);
+    }
+
+    std::atomic<bool> failed{false};
+
+private:
+    std::mutex mu_;
+    std::exception_ptr error_;
+};
+
+// 读取线程按序产生任务, 工作线程乱序处理, 调用线程按 seq 重排后写出。
+// 同时在途的任务数固定为 in_flight, 任务对象与输入/输出缓冲区均循环使用。
+template <typename ReadFn, typename WorkFn, typename WriteFn>
+void run_pipeline(unsigned threads, size_t in_size, size_t out_size, ReadFn read, WorkFn work,
+                  WriteFn write) {
+    const size_t in_flight = size_t(threads) * 2 + 2;
+    std::vector<Job> jobs(in_flight);
+    BoundedQueue<Job*> free_jobs(round_up_pow2(in_flight));
+    BoundedQueue<Job*> work_queue(round_up_pow2(in_flight + threads));
+    BoundedQueue<Job*> done_queue(round_up_pow2(in_flight));
+    BufferPool in_pool(in_flight, in_size);
+    BufferPool out_pool(in_flight, out_size);
+    for (Job& j : jobs) free_jobs.push(&j);
+
+    FirstError error;
+    std::atomic<uint64_t> total{UINT64_MAX};
+
+    std::thread reader([&] {
+        trace_thread_name("reader");
+        uint64_t seq = 0;
+        try {
+            Job* j = nullptr;
+            while (free_jobs.pop(j, error.failed)) {
+                j->seq = seq;
+                j->in = in_pool.acquire();
+                if (!read(*j)) {
+                    in_pool.release(j->in);
+                    free_jobs.push(j);
+                    break;
+                }
+                work_queue.push(j);
+                ++seq;
+            }
+        } catch (...) {
+            error.set(std::current_exception());
+        }
+        total.store(seq, std::memory_order_release);
+        for (unsigned i = 0; i < threads; ++i) work_queue.push(nullptr);
+    });
+
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&] {
+            trace_thread_name("worker");
+            Job* j = nullptr;
+            while (work_queue.pop(j, error.failed) && j != nullptr) {
+                j->out = out_pool.acquire();
+                try {
+                    work(*j);
+                } catch (...) {
+                    error.set(std::current_exception());
+                }
+                in_pool.release(j->in);
+                j->in = nullptr;
+                done_queue.push(j);
+            }
+        });
+    }
+
+    std::vector<Job*> pending(in_flight, nullptr);
+    uint64_t next = 0;
+    Backoff backoff;
+    while (next != total.load(std::memory_order_acquire) && !error.failed.load()) {
+        Job* j = nullptr;
+        if (!done_queue.try_pop(j)) {
+            backoff.pause();
+            continue;
+        }
+        backoff.reset();
+        pending[j->seq % in_flight] = j;
+        while ((j = pending[next % in_flight]) != nullptr) {
+            pending[next % in_flight] = nullptr;
+            try {
+                if (!error.failed.load()) write(*j);
+            } catch (...) {
+                error.set(std::current_exception());
+            }
+            out_pool.release(j->out);
+            j->out = nullptr;
+            free_jobs.push(j);
+            ++next;
+        }
+    }
+
+    reader.join();
+    for (std::thread& w : workers) w.join();
+    error.rethrow();
+}
+
+std::runtime_error corrupt(const std::string& path, const std::string& why) {
+    return std::runtime_error("corrupt payload " + path + ": " + why);
+}
+
+} // namespace
+
+void put_frame_header(uint8_t* p, size_t chunk_size) {
+    std::memset(p, 0, kFrameHeaderSize);
+    std::memcpy(p, kFrameMagic, 8);
+    put_le32(p + 8, uint32_t(chunk_size));
+}
+
+const char* parse_frame_header(const uint8_t* p, size_t* chunk_size) {
+    if (std::memcmp(p, kFrameMagic, 8) != 0) return "bad frame header";
+    *chunk_size = get_le32(p + 8);
+    if (*chunk_size == 0 || *chunk_size > kMaxChunkSize) return "bad chunk size";
+    return nullptr;
+}
+
+ChunkHeader encode_chunk(const uint8_t* src, size_t len, uint8_t* dst) {
+    ChunkHeader h;
+    h.raw_len = uint32_t(len);
+    const size_t n = len > 1 ? lz4_compress(src, len, dst, len - 1) : 0;
+    if (n == 0) {
+        std::memcpy(dst, src, len);
+        h.payload_len = uint32_t(len);
+        h.stored = true;
+    } else {
+        h.payload_len = uint32_t(n);
+    }
+    return h;
+}
+
+void put_chunk_header(uint8_t* p, const ChunkHeader& h) {
+    put_le32(p, h.raw_len);
+    put_le32(p + 4, h.payload_len | (h.stored ? kChunkStored : 0));
+}
+
+const char* parse_chunk_header(const uint8_t* p, size_t chunk_size, ChunkHeader* h) {
+    const uint32_t stored = get_le32(p + 4);
+    h->raw_len = get_le32(p);
+    h->payload_len = stored & ~kChunkStored;
+    h->stored = (stored & kChunkStored) != 0;
+    if (h->raw_len == 0) return stored != 0 ? "bad end marker" : nullptr;
+    if (h->raw_len > chunk_size || h->payload_len > chunk_size ||
+        (h->stored && h->payload_len != h->raw_len)) {
+        return "bad chunk header";
+    }
+    return nullptr;
+}
+
+bool decode_chunk(const ChunkHeader& h, const uint8_t* payload, uint8_t* dst) {
+    if (h.stored) {
+        std::memcpy(dst, payload, h.raw_len);
+        return true;
+    }
+    return lz4_decompress(payload, h.payload_len, dst, h.raw_len) == h.raw_len;
+}
+
+PipelineStats compress_file(const std::string& in_path, const std::string& out_path,
+                            const PipelineOptions& opts) {
+    if (opts.chunk_size == 0 || opts.chunk_size > kMaxChunkSize) {
+        throw std::invalid_argument("chunk size out of range");
+    }
+
+    FileDescriptor in(in_path, O_RDONLY);
+    FileDescriptor out(out_path, O_WRONLY | O_CREAT | O_TRUNC);
+
+    uint8_t header[kFrameHeaderSize];
+    put_frame_header(header, opts.chunk_size);
+    out.write_full(header, sizeof(header));
+
+    PipelineStats stats;
+    stats.threads = resolve_threads(opts.threads);
+
+    auto read = [&](Job& j) {
+        TraceSpan span(Stage::Read);
+        j.in_len = in.read_full(j.in, opts.chunk_size);
+        span.add_bytes(j.in_len);
+        return j.in_len > 0;
+    };
+    auto work = [](Job& j) {
+        TraceSpan span(Stage::Compress, j.in_len);
+        j.header = encode_chunk(j.in, j.in_len, j.out);
+    };
+    auto write = [&](const Job& j) {
+        TraceSpan span(Stage::Write, kChunkHeaderSize + j.header.payload_len);
+        uint8_t hdr[kChunkHeaderSize];
+        put_chunk_header(hdr, j.header);
+        out.write_full(hdr, sizeof(hdr));
+        out.write_full(j.out, j.header.payload_len);
+        ++stats.chunks;
+        stats.raw_bytes += j.header.raw_len;
+        stats.stored_bytes += kChunkHeaderSize + j.header.payload_len;
+    };
+
+    run_pipeline(stats.threads, opts.chunk_size, opts.chunk_size, read, work, write);
+
+    const uint8_t end[kChunkHeaderSize] = {};
+    out.write_full(end, sizeof(end));
+    out.sync();
+    return stats;
+}
+
+PipelineStats decompress_file(const std::string& in_path, const std::string& out_path,
+                              const PipelineOptions& opts) {
+    FileDescriptor in(in_path, O_RDONLY);
+
+    uint8_t header[kFrameHeaderSize];
+    if (in.read_full(header, sizeof(header)) != sizeof(header)) {
+        throw corrupt(in_path, "bad frame header");
+    }
+    size_t chunk_size = 0;
+    if (const char* why = parse_frame_header(header, &chunk_size)) throw corrupt(in_path, why);
+
+    BlockWriter out(out_path, opts.writer);
+
+    PipelineStats stats;
+    stats.threads = resolve_threads(opts.threads);
+    stats.writer_backend = out.backend_name();
+
+    auto read = [&](Job& j) {
+        TraceSpan span(Stage::Read);
+        uint8_t hdr[kChunkHeaderSize];
+        if (in.read_full(hdr, sizeof(hdr)) != sizeof(hdr)) throw corrupt(in_path, "truncated");
+        if (const char* why = parse_chunk_header(hdr, chunk_size, &j.header)) {
+            throw corrupt(in_path, why);
+        }
+        if (j.header.raw_len == 0) return false;
+        if (in.read_full(j.in, j.header.payload_len) != j.header.payload_len) {
+            throw corrupt(in_path, "truncated");
+        }
+        span.add_bytes(kChunkHeaderSize + j.header.payload_len);
+        return true;
+    };
+    auto work = [&](Job& j) {
+        TraceSpan span(Stage::Decompress, j.header.raw_len);
+        if (!decode_chunk(j.header, j.in, j.out)) {
+            throw corrupt(in_path, "chunk " + std::to_string(j.seq) + " does not decode");
+        }
+    };
+    auto write = [&](const Job& j) {
+        out.write(j.out, j.header.raw_len);
+        ++stats.chunks;
+        stats.raw_bytes += j.header.raw_len;
+        stats.stored_bytes += kChunkHeaderSize + j.header.payload_len;
+    };
+
+    run_pipeline(stats.threads, chunk_size, chunk_size, read, work, write);
+
+    out.finish();
+    return stats;
+}
+
+} // namespace ota
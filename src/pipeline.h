@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "block_writer.h"
+
+namespace ota {
+
+// 分块压缩帧格式 (小端), 各块相互独立, 可并行解压:
+//   header: magic "OTALZ401" | chunk_size u32 | reserved u32
+//   chunk:  raw_len u32 | stored_len u32 (最高位置 1 表示未压缩) | payload
+//   end:    raw_len = 0, stored_len = 0
+const char kFrameMagic[8] = {'O', 'T', 'A', 'L', 'Z', '4', '0', '1'};
+const size_t kFrameHeaderSize = 16;
+const size_t kChunkHeaderSize = 8;
+const uint32_t kChunkStored = 0x80000000u;
+const size_t kMaxChunkSize = 256u << 20;
+
+// 帧头与块头的编解码, compress/decompress、压缩基础镜像与补丁记录流共用。
+// 解析函数在格式错误时返回原因, 合法时返回 nullptr, 由调用方加上文件名抛出
+struct ChunkHeader {
+    uint32_t raw_len = 0;      // 0 表示结束标记
+    uint32_t payload_len = 0;  // 块头之后的负载长度
+    bool stored = false;       // 负载为未压缩的原始数据
+};
+
+void put_frame_header(uint8_t* p, size_t chunk_size);
+const char* parse_frame_header(const uint8_t* p, size_t* chunk_size);
+
+// 压缩一块到 dst (至少 len 字节); 压缩后不小于原始数据时原样存储
+ChunkHeader encode_chunk(const uint8_t* src, size_t len, uint8_t* dst);
+void put_chunk_header(uint8_t* p, const ChunkHeader& h);
+const char* parse_chunk_header(const uint8_t* p, size_t chunk_size, ChunkHeader* h);
+// 解码负载到 dst (至少 raw_len 字节), 数据损坏时返回 false
+bool decode_chunk(const ChunkHeader& h, const uint8_t* payload, uint8_t* dst);
+
+struct PipelineOptions {
+    size_t chunk_size = 1u << 20;  // 仅压缩时使用, 解压从帧头读取
+    unsigned threads = 0;          // 0 = 硬件线程数
+    WriterOptions writer;          // 解压输出的写出方式
+};
+
+struct PipelineStats {
+    uint64_t chunks = 0;
+    uint64_t raw_bytes = 0;
+    uint64_t stored_bytes = 0;
+    unsigned threads = 0;
+    const char* writer_backend = "";
+};
+
+// 读取 -> N 个工作线程 -> 按序写出; 缓冲区全部来自预分配池
+PipelineStats compress_file(const std::string& in_path, const std::string& out_path,
+                            const PipelineOptions& opts);
+PipelineStats decompress_file(const std::string& in_path, const std::string& out_path,
+                              const PipelineOptions& opts);
+
+} // namespace ota
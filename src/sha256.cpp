@@ -0,0 +1,244 @@
+#include "sha256.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define OTA_HAVE_X86 1
+#endif
+
+namespace ota {
+
+namespace {
+
+alignas(16) const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+const uint32_t H0[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+inline uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+inline uint32_t load_be32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+void compress_scalar(uint32_t state[8], const uint8_t* data, size_t blocks) {
+    uint32_t w[64];
+    while (blocks--) {
+        for (int i = 0; i < 16; ++i) w[i] = load_be32(data + 4 * i);
+        for (int i = 16; i < 64; ++i) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; ++i) {
+            uint32_t S1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+            uint32_t ch = (e & f) ^ (~e & g);
+            uint32_t t1 = h + S1 + ch + K[i] + w[i];
+            uint32_t S0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+            uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = S0 + maj;
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+        data += 64;
+    }
+}
+
+#ifdef OTA_HAVE_X86
+// Intel SHA 扩展: 每条 sha256rnds2 完成两轮, 状态以 ABEF/CDGH 形式保存在两个寄存器中
+__attribute__((target("sha,sse4.1,ssse3")))
+void compress_shani(uint32_t state[8], const uint8_t* data, size_t blocks) {
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    __m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0]));
+    __m128i state1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4]));
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);              // CDAB
+    state1 = _mm_shuffle_epi32(state1, 0x1B);        // EFGH
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8); // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);     // CDGH
+
+    while (blocks--) {
+        const __m128i abef_save = state0;
+        const __m128i cdgh_save = state1;
+
+        __m128i msg[4];
+        for (int i = 0; i < 4; ++i) {
+            msg[i] = _mm_shuffle_epi8(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * i)), mask);
+        }
+
+        // 16 组, 每组 4 轮; msg[r & 3] 始终保存 W[4r .. 4r+3]
+        for (int r = 0; r < 16; ++r) {
+            __m128i m = _mm_add_epi32(msg[r & 3],
+                                      _mm_load_si128(reinterpret_cast<const __m128i*>(&K[4 * r])));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, m);
+            m = _mm_shuffle_epi32(m, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, m);
+
+            if (r < 12) {
+                __m128i t = _mm_sha256msg1_epu32(msg[r & 3], msg[(r + 1) & 3]);
+                t = _mm_add_epi32(t, _mm_alignr_epi8(msg[(r + 3) & 3], msg[(r + 2) & 3], 4));
+                msg[r & 3] = _mm_sha256msg2_epu32(t, msg[(r + 3) & 3]);
+            }
+        }
+
+        state0 = _mm_add_epi32(state0, abef_save);
+        state1 = _mm_add_epi32(state1, cdgh_save);
+        data += 64;
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);           // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xB1);        // DCHG
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);     // DCBA
+    state1 = _mm_alignr_epi8(state1, tmp, 8);        // HGFE
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+}
+
+bool cpu_has_shani() {
+    unsigned eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+    const bool ssse3 = (ecx & bit_SSSE3) != 0;
+    const bool sse41 = (ecx & bit_SSE4_1) != 0;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return false;
+    const bool sha = (ebx & (1u << 29)) != 0;
+    return ssse3 && sse41 && sha;
+}
+#endif
+
+using CompressFn = void (*)(uint32_t*, const uint8_t*, size_t);
+
+struct Impl {
+    CompressFn fn;
+    const char* name;
+};
+
+Impl select_impl() {
+    // OTA_SHA256_IMPL=scalar 可强制使用标量实现, 便于对比测试
+    const char* force = std::getenv("OTA_SHA256_IMPL");
+    const bool want_scalar = force && std::strcmp(force, "scalar") == 0;
+#ifdef OTA_HAVE_X86
+    if (!want_scalar && cpu_has_shani()) return {compress_shani, "sha-ni"};
+#endif
+    (void)want_scalar;
+    return {compress_scalar, "scalar"};
+}
+
+const Impl& impl() {
+    static const Impl selected = select_impl();
+    return selected;
+}
+
+} // namespace
+
+Sha256::Sha256() { reset(); }
+
+void Sha256::reset() {
+    std::memcpy(state_, H0, sizeof(state_));
+    buf_len_ = 0;
+    total_len_ = 0;
+}
+
+void Sha256::update(const void* data, size_t len) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    const CompressFn compress = impl().fn;
+    total_len_ += len;
+
+    if (buf_len_ > 0) {
+        size_t take = 64 - buf_len_;
+        if (take > len) take = len;
+        std::memcpy(buf_ + buf_len_, p, take);
+        buf_len_ += take;
+        p += take;
+        len -= take;
+        if (buf_len_ < 64) return;
+        compress(state_, buf_, 1);
+        buf_len_ = 0;
+    }
+
+    const size_t blocks = len / 64;
+    if (blocks > 0) {
+        compress(state_, p, blocks);
+        p += blocks * 64;
+        len -= blocks * 64;
+    }
+
+    if (len > 0) {
+        std::memcpy(buf_, p, len);
+        buf_len_ = len;
+    }
+}
+
+Digest Sha256::finish() {
+    const uint64_t bit_len = total_len_ * 8;
+    uint8_t pad[72];
+    size_t pad_len = (buf_len_ < 56) ? (56 - buf_len_) : (120 - buf_len_);
+    std::memset(pad, 0, sizeof(pad));
+    pad[0] = 0x80;
+    for (int i = 0; i < 8; ++i) pad[pad_len + i] = uint8_t(bit_len >> (56 - 8 * i));
+    update(pad, pad_len + 8);
+
+    Digest out;
+    for (int i = 0; i < 8; ++i) {
+        out[4 * i + 0] = uint8_t(state_[i] >> 24);
+        out[4 * i + 1] = uint8_t(state_[i] >> 16);
+        out[4 * i + 2] = uint8_t(state_[i] >> 8);
+        out[4 * i + 3] = uint8_t(state_[i]);
+    }
+    reset();
+    return out;
+}
+
+Digest Sha256::hash(const void* data, size_t len) {
+    Sha256 h;
+    h.update(data, len);
+    return h.finish();
+}
+
+const char* Sha256::impl_name() { return impl().name; }
+
+std::string to_hex(const Digest& d) {
+    static const char digits[] = "0123456789abcdef";
+    std::string s(d.size() * 2, '0');
+    for (size_t i = 0; i < d.size(); ++i) {
+        s[2 * i] = digits[d[i] >> 4];
+        s[2 * i + 1] = digits[d[i] & 0xF];
+    }
+    return s;
+}
+
+bool from_hex(const std::string& hex, Digest& out) {
+    if (hex.size() != out.size() * 2) return false;
+    auto nibble = [](char c) -> int {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    };
+    for (size_t i = 0; i < out.size(); ++i) {
+        int hi = nibble(hex[2 * i]);
+        int lo = nibble(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0) return false;
+        out[i] = uint8_t((hi << 4) | lo);
+    }
+    return true;
+}
+
+} // namespace ota
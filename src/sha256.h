@@ -0,0 +1,36 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace ota {
+
+using Digest = std::array<uint8_t, 32>;
+
+// 流式 SHA-256。压缩函数在首次使用时按 CPU 特性选择 (SHA-NI / 标量)。
+class Sha256 {
+public:
+    Sha256();
+
+    void reset();
+    void update(const void* data, size_t len);
+    Digest finish();
+
+    static Digest hash(const void* data, size_t len);
+
+    // 当前选中的实现名称, 例如 "sha-ni" 或 "scalar"
+    static const char* impl_name();
+
+private:
+    uint32_t state_[8];
+    uint8_t buf_[64];
+    size_t buf_len_;
+    uint64_t total_len_;
+};
+
+std::string to_hex(const Digest& d);
+bool from_hex(const std::string& hex, Digest& out);
+
+} // namespace ota
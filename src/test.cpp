@@ -1,6 +1,298 @@
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <initializer_list>
 #include <iostream>
+#include <map>
+#include <string>
+#include <vector>
 
-int main() {
-    std::cout << "Hello, world!" << std::endl;
+#include "batch.h"
+#include "dedup.h"
+#include "delta.h"
+#include "merkle.h"
+#include "pipeline.h"
+#include "sha256.h"
+#include "trace.h"
+#include "verify.h"
+
+namespace {
+
+// 简单的命令行解析: "--key value" 或 "--flag" 形式的选项, 其余为位置参数
+struct Args {
+    std::vector<std::string> positional;
+    std::map<std::string, std::string> options;
+
+    Args(int argc, char** argv, int first) {
+        for (int i = first; i < argc; ++i) {
+            std::string a = argv[i];
+            if (a.size() > 2 && a.compare(0, 2, "--") == 0) {
+                // 后面没有值 (或紧跟另一个选项) 时视为开关
+                std::string value = "1";
+                if (i + 1 < argc && std::string(argv[i + 1]).compare(0, 2, "--") != 0) value = argv[++i];
+                options[a.substr(2)] = value;
+            } else {
+                positional.push_back(a);
+            }
+        }
+    }
+
+    bool has(const std::string& key) const { return options.count(key) != 0; }
+
+    std::string get(const std::string& key, const std::string& def = std::string()) const {
+        auto it = options.find(key);
+        return it == options.end() ? def : it->second;
+    }
+
+    uint64_t get_u64(const std::string& key, uint64_t def) const {
+        auto it = options.find(key);
+        return it == options.end() ? def : std::strtoull(it->second.c_str(), nullptr, 0);
+    }
+};
+
+void usage() {
+    std::cerr << "usage:\n"
+                 "  test_exe verify <image> [--expect <sha256>] [--chunk-mib <n>]\n"
+                 "  test_exe diff --base <old.img> --new <new.img> --out <p.delta>\n"
+                 "  test_exe apply --base <old.img> --patch <p.delta> --out <new.img>\n"
+                 "                 [--block-kib <n>] [--mem-mib <n>] [--journal <path>] [writer options]\n"
+                 "  test_exe compress --in <raw> --out <payload> [--chunk-kib <n>] [--threads <n>]\n"
+                 "  test_exe decompress --in <payload> --out <raw> [--threads <n>] [writer options]\n"
+                 "  test_exe store --store <dir> --in <image> --recipe <out.recipe> [--avg-kib <n>]\n"
+                 "  test_exe restore --store <dir> --recipe <in.recipe> --out <image> [writer options]\n"
+                 "  test_exe manifest --in <image> --out <m.mkl> [--block-kib <n>] [--threads <n>]\n"
+                 "  test_exe verify-blocks <image> --manifest <m.mkl> [--first <n>] [--count <n>]\n"
+                 "                 [--root <sha256>]\n"
+                 "  test_exe batch --manifest <jobs.json> [--threads <n>] [--cache-mib <n>]\n"
+                 "                 [--block-kib <n>] [--mem-mib <n>] [writer options]\n"
+                 "writer options:\n"
+                 "  --writer auto|uring|pwrite  --direct  --queue-depth <n>  --fsync-mib <n>\n"
+                 "common options:\n"
+                 "  --trace <out.json>  per-stage timings as Chrome trace JSON, written on exit\n"
+                 "                      and on SIGUSR1; stage summary printed to stderr\n";
+}
+
+bool require(const Args& args, std::initializer_list<const char*> keys) {
+    for (const char* k : keys) {
+        if (args.get(k).empty()) {
+            std::cerr << "missing --" << k << '\n';
+            usage();
+            return false;
+        }
+    }
+    return true;
+}
+
+// 解析写出端选项, 出错时返回 false
+bool parse_writer(const Args& args, ota::WriterOptions* opts) {
+    if (args.has("writer") && !ota::parse_backend(args.get("writer"), &opts->backend)) {
+        std::cerr << "unknown --writer " << args.get("writer") << '\n';
+        return false;
+    }
+    opts->direct = args.get_u64("direct", 0) != 0;
+    opts->queue_depth = unsigned(args.get_u64("queue-depth", opts->queue_depth));
+    opts->fsync_interval = args.get_u64("fsync-mib", opts->fsync_interval >> 20) << 20;
+    return true;
+}
+
+int cmd_verify(const Args& args) {
+    if (args.positional.size() != 1) {
+        usage();
+        return 1;
+    }
+    const std::string& path = args.positional[0];
+    const uint64_t chunk = args.get_u64("chunk-mib", ota::kDefaultVerifyChunk >> 20) << 20;
+
+    const ota::Digest digest = ota::hash_image(path, chunk);
+    std::cout << ota::to_hex(digest) << "  " << path << '\n';
+
+    if (args.has("expect")) {
+        ota::Digest expected;
+        if (!ota::from_hex(args.get("expect"), expected)) {
+            std::cerr << "invalid --expect digest\n";
+            return 1;
+        }
+        if (expected != digest) {
+            std::cerr << "verify FAILED (" << ota::Sha256::impl_name() << ")\n";
+            return 2;
+        }
+        std::cerr << "verify OK (" << ota::Sha256::impl_name() << ")\n";
+    }
+    return 0;
+}
+
+int cmd_diff(const Args& args) {
+    if (!require(args, {"base", "new", "out"})) return 1;
+    const ota::DeltaDiffStats st = ota::delta_diff(args.get("base"), args.get("new"), args.get("out"));
+    std::cout << "records " << st.records << ", diff bytes " << st.diff_bytes << ", extra bytes "
+              << st.extra_bytes << ", patch " << st.patch_bytes << " bytes\n";
     return 0;
-}
\ No newline at end of file
+}
+
+int cmd_apply(const Args& args) {
+    if (!require(args, {"base", "patch", "out"})) return 1;
+    ota::DeltaApplyOptions opts;
+    opts.block_size = size_t(args.get_u64("block-kib", opts.block_size >> 10) << 10);
+    opts.mem_limit = size_t(args.get_u64("mem-mib", opts.mem_limit >> 20) << 20);
+    opts.journal_path = args.get("journal");
+    if (!parse_writer(args, &opts.writer)) return 1;
+
+    const ota::DeltaApplyStats st =
+        ota::delta_apply(args.get("base"), args.get("patch"), args.get("out"), opts);
+    std::cout << "applied " << st.records << " records, " << st.new_size << " bytes, peak buffer "
+              << st.peak_mem << " bytes, writer " << st.writer_backend
+              << (st.direct ? " (O_DIRECT)" : "") << '\n';
+    if (st.resumed_from > 0) std::cout << "resumed at byte " << st.resumed_from << '\n';
+    return 0;
+}
+
+void print_pipeline_stats(const ota::PipelineStats& st) {
+    std::cout << st.chunks << " chunks, " << st.raw_bytes << " raw bytes, " << st.stored_bytes
+              << " stored bytes, " << st.threads << " threads";
+    if (*st.writer_backend) std::cout << ", writer " << st.writer_backend;
+    std::cout << '\n';
+}
+
+int cmd_compress(const Args& args) {
+    if (!require(args, {"in", "out"})) return 1;
+    ota::PipelineOptions opts;
+    opts.chunk_size = size_t(args.get_u64("chunk-kib", opts.chunk_size >> 10) << 10);
+    opts.threads = unsigned(args.get_u64("threads", 0));
+    print_pipeline_stats(ota::compress_file(args.get("in"), args.get("out"), opts));
+    return 0;
+}
+
+int cmd_decompress(const Args& args) {
+    if (!require(args, {"in", "out"})) return 1;
+    ota::PipelineOptions opts;
+    opts.threads = unsigned(args.get_u64("threads", 0));
+    if (!parse_writer(args, &opts.writer)) return 1;
+    print_pipeline_stats(ota::decompress_file(args.get("in"), args.get("out"), opts));
+    return 0;
+}
+
+int cmd_store(const Args& args) {
+    if (!require(args, {"store", "in", "recipe"})) return 1;
+    ota::CdcParams params;
+    if (args.has("avg-kib")) {
+        params.avg_size = size_t(args.get_u64("avg-kib", 0) << 10);
+        params.min_size = params.avg_size / 4;
+        params.max_size = params.avg_size * 4;
+    }
+    const ota::DedupStats st =
+        ota::store_image(args.get("in"), args.get("store"), args.get("recipe"), params);
+    std::cout << st.chunks << " chunks, " << st.new_chunks << " new (" << st.new_bytes << " of "
+              << st.image_size << " bytes stored)\n";
+    return 0;
+}
+
+int cmd_restore(const Args& args) {
+    if (!require(args, {"store", "recipe", "out"})) return 1;
+    ota::WriterOptions writer;
+    if (!parse_writer(args, &writer)) return 1;
+    const uint64_t n = ota::restore_image(args.get("recipe"), args.get("store"), args.get("out"), writer);
+    std::cout << "restored " << n << " bytes\n";
+    return 0;
+}
+
+int cmd_manifest(const Args& args) {
+    if (!require(args, {"in", "out"})) return 1;
+    const uint32_t block = uint32_t(args.get_u64("block-kib", ota::kDefaultManifestBlock >> 10) << 10);
+    const ota::ManifestStats st = ota::build_manifest(args.get("in"), args.get("out"), block,
+                                                      unsigned(args.get_u64("threads", 0)));
+    std::cout << ota::to_hex(st.root) << "  " << args.get("in") << '\n';
+    std::cerr << st.leaf_count << " blocks of " << st.block_size << " bytes, " << st.levels
+              << " levels, " << st.threads << " threads\n";
+    return 0;
+}
+
+int cmd_verify_blocks(const Args& args) {
+    if (args.positional.size() != 1) {
+        usage();
+        return 1;
+    }
+    if (!require(args, {"manifest"})) return 1;
+    const ota::MerkleManifest manifest(args.get("manifest"));
+    if (args.has("root")) {
+        ota::Digest root;
+        if (!ota::from_hex(args.get("root"), root)) {
+            std::cerr << "invalid --root digest\n";
+            return 1;
+        }
+        if (root != manifest.root()) {
+            std::cerr << "manifest root does not match --root\n";
+            return 2;
+        }
+    }
+    const uint64_t first = args.get_u64("first", 0);
+    const uint64_t count = args.get_u64("count", 1);
+    uint64_t hashes = 0;
+    const bool ok = ota::verify_blocks(args.positional[0], manifest, first, count, &hashes);
+    std::cerr << "blocks " << first << ".." << first + count - 1 << " of " << manifest.leaf_count()
+              << (ok ? " OK" : " FAILED") << " (" << hashes << " hashes)\n";
+    return ok ? 0 : 2;
+}
+
+int cmd_batch(const Args& args) {
+    if (!require(args, {"manifest"})) return 1;
+    ota::BatchOptions opts;
+    const std::vector<ota::BatchJob> jobs = ota::load_batch_manifest(args.get("manifest"), &opts);
+    opts.threads = unsigned(args.get_u64("threads", opts.threads));
+    opts.cache_bytes = size_t(args.get_u64("cache-mib", opts.cache_bytes >> 20) << 20);
+    opts.apply.block_size = size_t(args.get_u64("block-kib", opts.apply.block_size >> 10) << 10);
+    opts.apply.mem_limit = size_t(args.get_u64("mem-mib", opts.apply.mem_limit >> 20) << 20);
+    if (!parse_writer(args, &opts.apply.writer)) return 1;
+
+    std::vector<ota::BatchJobResult> results;
+    const ota::BatchStats st = ota::run_batch(jobs, opts, &results);
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        const ota::BatchJobResult& r = results[i];
+        if (r.ok) {
+            std::cout << "ok " << jobs[i].out << ": " << r.stats.records << " records, "
+                      << r.stats.new_size << " bytes";
+            if (r.stats.resumed_from > 0) std::cout << ", resumed at byte " << r.stats.resumed_from;
+            std::cout << '\n';
+        } else {
+            std::cout << "FAILED " << jobs[i].out << ": " << r.error << '\n';
+        }
+    }
+    std::cerr << st.jobs << " jobs (" << st.failed << " failed), " << st.bases << " base images ("
+              << st.compressed_bases << " compressed), " << st.threads << " threads\n";
+    if (st.compressed_bases > 0) {
+        std::cerr << "base cache: " << st.cache_blocks << " blocks, " << st.cache.decoded
+                  << " decoded, " << st.cache.hits << " hits, " << st.cache.waits << " waits, "
+                  << st.cache.evictions << " evictions\n";
+    }
+    return st.failed == 0 ? 0 : 1;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        usage();
+        return 1;
+    }
+    const std::string cmd = argv[1];
+    const Args args(argc, argv, 2);
+
+    try {
+        if (args.has("trace")) ota::trace_start(args.get("trace"));
+        if (cmd == "verify") return cmd_verify(args);
+        if (cmd == "diff") return cmd_diff(args);
+        if (cmd == "apply") return cmd_apply(args);
+        if (cmd == "compress") return cmd_compress(args);
+        if (cmd == "decompress") return cmd_decompress(args);
+        if (cmd == "store") return cmd_store(args);
+        if (cmd == "restore") return cmd_restore(args);
+        if (cmd == "manifest") return cmd_manifest(args);
+        if (cmd == "verify-blocks") return cmd_verify_blocks(args);
+        if (cmd == "batch") return cmd_batch(args);
+    } catch (const std::exception& e) {
+        std::cerr << "error: " << e.what() << '\n';
+        return 1;
+    }
+
+    usage();
+    return 1;
+}
@@ -0,0 +1,353 @@
+#include "trace.h"
+
+#include <stdexcept>
+
+#if OTA_TRACE
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "file_io.h"
+#endif
+
+namespace ota {
+
+const char* stage_name(Stage stage) {
+    static const char* const names[kStageCount] = {"read",  "verify", "decompress", "compress",
+                                                   "patch", "write",  "sync"};
+    return names[unsigned(stage)];
+}
+
+#if OTA_TRACE
+
+std::atomic<bool> g_trace_enabled{false};
+
+namespace {
+
+// 对数分桶: 小于 16 的值各占一桶, 之后每个 2 的幂区间再等分 16 份
+const unsigned kSubBits = 4;
+const unsigned kSubCount = 1u << kSubBits;
+const unsigned kBuckets = (64 - kSubBits + 1) * kSubCount;
+const size_t kEventCapacity = 1u << 15;  // 每线程保留最近的区间数
+
+unsigned bucket_of(uint64_t v) {
+    if (v < kSubCount) return unsigned(v);
+    const unsigned msb = 63u - unsigned(__builtin_clzll(v));
+    return (msb - kSubBits + 1) * kSubCount + unsigned((v >> (msb - kSubBits)) & (kSubCount - 1));
+}
+
+uint64_t bucket_floor(unsigned b) {
+    if (b < kSubCount) return b;
+    return uint64_t(kSubCount + b % kSubCount) << (b / kSubCount - 1);
+}
+
+uint64_t now_ns() {
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch())
+                        .count());
+}
+
+// 仅由所属线程写入, 导出时其他线程只读, 故用 relaxed 读改写代替原子加
+void bump(std::atomic<uint64_t>& a, uint64_t n) {
+    a.store(a.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+struct StageStats {
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> total_ns{0};
+    std::atomic<uint64_t> max_ns{0};
+    std::atomic<uint64_t> buckets[kBuckets];
+
+    StageStats() {
+        for (auto& b : buckets) b.store(0, std::memory_order_relaxed);
+    }
+};
+
+// 环形缓冲区中的一个区间; stage 存在 bytes 的高 8 位
+struct Event {
+    std::atomic<uint64_t> start_ns;
+    std::atomic<uint64_t> dur_ns;
+    std::atomic<uint64_t> stage_bytes;
+};
+
+struct ThreadBuffer {
+    uint32_t tid = 0;
+    char name[32] = {};
+    bool in_use = true;  // 受 Registry::mu 保护
+    StageStats stages[kStageCount];
+    std::unique_ptr<Event[]> events{new Event[kEventCapacity]};
+    std::atomic<uint64_t> head{0};
+};
+
+// 线程缓冲区只增不删: 线程退出后缓冲区留给后来的线程复用, 数据在导出时仍然可见
+struct Registry {
+    std::mutex mu;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    std::string path;
+    uint64_t epoch_ns = 0;
+};
+
+Registry& registry() {
+    static Registry* r = new Registry;  // 不析构, atexit 导出时仍可用
+    return *r;
+}
+
+thread_local ThreadBuffer* t_buffer = nullptr;
+thread_local TraceSpan* t_current = nullptr;
+
+// 线程退出时归还缓冲区
+struct BufferRelease {
+    ~BufferRelease() {
+        if (!t_buffer) return;
+        std::lock_guard<std::mutex> lock(registry().mu);
+        t_buffer->in_use = false;
+        t_buffer = nullptr;
+    }
+};
+
+ThreadBuffer* acquire_buffer() {
+    static thread_local BufferRelease release;
+    (void)release;
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mu);
+    for (auto& b : r.buffers) {
+        if (!b->in_use) {
+            b->in_use = true;
+            return t_buffer = b.get();
+        }
+    }
+    r.buffers.emplace_back(new ThreadBuffer);
+    ThreadBuffer* b = r.buffers.back().get();
+    b->tid = uint32_t(r.buffers.size());
+    std::snprintf(b->name, sizeof(b->name), "thread-%u", unsigned(b->tid));
+    return t_buffer = b;
+}
+
+void record(Stage stage, uint64_t start, uint64_t dur, uint64_t self, uint64_t bytes) {
+    ThreadBuffer* b = t_buffer ? t_buffer : acquire_buffer();
+    StageStats& s = b->stages[unsigned(stage)];
+    bump(s.count, 1);
+    bump(s.bytes, bytes);
+    bump(s.total_ns, self);
+    if (self > s.max_ns.load(std::memory_order_relaxed)) {
+        s.max_ns.store(self, std::memory_order_relaxed);
+    }
+    bump(s.buckets[bucket_of(self)], 1);
+
+    const uint64_t h = b->head.load(std::memory_order_relaxed);
+    Event& e = b->events[h & (kEventCapacity - 1)];
+    e.start_ns.store(start, std::memory_order_relaxed);
+    e.dur_ns.store(dur, std::memory_order_relaxed);
+    e.stage_bytes.store((uint64_t(stage) << 56) | (bytes & ((1ull << 56) - 1)),
+                        std::memory_order_relaxed);
+    b->head.store(h + 1, std::memory_order_release);
+}
+
+// 汇总各线程的同一阶段
+struct Summary {
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+    uint64_t total_ns = 0;
+    uint64_t max_ns = 0;
+    std::vector<uint64_t> buckets = std::vector<uint64_t>(kBuckets, 0);
+
+    uint64_t percentile(double p) const {
+        const uint64_t rank = uint64_t(p * double(count));
+        uint64_t seen = 0;
+        for (unsigned b = 0; b < kBuckets; ++b) {
+            seen += buckets[b];
+            if (seen > rank) return std::min(bucket_floor(b), max_ns);
+        }
+        return max_ns;
+    }
+};
+
+void append(std::string& out, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+void append(std::string& out, const char* fmt, ...) {
+    char buf[512];
+    va_list ap;
+    va_start(ap, fmt);
+    const int n = std::vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n > 0) out.append(buf, std::min(size_t(n), sizeof(buf) - 1));
+}
+
+void dump_at_exit() {
+    try {
+        trace_dump(true);
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "warning: trace dump failed: %s\n", e.what());
+    }
+}
+
+void signal_loop(sigset_t set) {
+    for (;;) {
+        int sig = 0;
+        if (sigwait(&set, &sig) != 0) continue;
+        try {
+            trace_dump(false);
+        } catch (const std::exception& e) {
+            std::fprintf(stderr, "warning: trace dump failed: %s\n", e.what());
+        }
+    }
+}
+
+} // namespace
+
+void TraceSpan::begin_slow(Stage stage, uint64_t bytes) {
+    active_ = true;
+    stage_ = stage;
+    bytes_ = bytes;
+    child_ns_ = 0;
+    parent_ = t_current;
+    t_current = this;
+    start_ns_ = now_ns();
+}
+
+void TraceSpan::end_slow() {
+    const uint64_t dur = now_ns() - start_ns_;
+    active_ = false;
+    t_current = parent_;
+    if (parent_) parent_->child_ns_ += dur;
+    record(stage_, start_ns_, dur, dur > child_ns_ ? dur - child_ns_ : 0, bytes_);
+}
+
+void trace_thread_name(const char* name) {
+    if (!trace_enabled()) return;
+    ThreadBuffer* b = t_buffer ? t_buffer : acquire_buffer();
+    std::lock_guard<std::mutex> lock(registry().mu);
+    std::snprintf(b->name, sizeof(b->name), "%s", name);
+}
+
+void trace_start(const std::string& path) {
+    Registry& r = registry();
+    {
+        std::lock_guard<std::mutex> lock(r.mu);
+        if (g_trace_enabled.load()) throw std::logic_error("tracing already started");
+        r.path = path;
+        r.epoch_ns = now_ns();
+    }
+
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    if (pthread_sigmask(SIG_BLOCK, &set, nullptr) != 0) {
+        throw std::runtime_error("cannot block SIGUSR1");
+    }
+    std::thread(signal_loop, set).detach();
+
+    g_trace_enabled.store(true);
+    trace_thread_name("main");
+    std::atexit(dump_at_exit);
+}
+
+void trace_dump(bool summary) {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mu);
+    if (r.path.empty()) return;
+
+    const unsigned pid = unsigned(::getpid());
+    std::string out;
+    out.reserve(1u << 20);
+    out += "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    append(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":0,"
+                "\"args\":{\"name\":\"ota\"}}", pid);
+
+    Summary totals[kStageCount];
+    uint64_t dropped = 0;
+    for (const auto& b : r.buffers) {
+        append(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,"
+                    "\"args\":{\"name\":\"%s\"}}", pid, unsigned(b->tid), b->name);
+
+        for (unsigned s = 0; s < kStageCount; ++s) {
+            const StageStats& st = b->stages[s];
+            Summary& t = totals[s];
+            t.count += st.count.load(std::memory_order_relaxed);
+            t.bytes += st.bytes.load(std::memory_order_relaxed);
+            t.total_ns += st.total_ns.load(std::memory_order_relaxed);
+            t.max_ns = std::max(t.max_ns, st.max_ns.load(std::memory_order_relaxed));
+            for (unsigned k = 0; k < kBuckets; ++k) {
+                t.buckets[k] += st.buckets[k].load(std::memory_order_relaxed);
+            }
+        }
+
+        // 环形缓冲区只保留最近 kEventCapacity 个区间; 线程仍在运行时最旧的几个可能正被覆盖
+        const uint64_t head = b->head.load(std::memory_order_acquire);
+        const uint64_t first = head > kEventCapacity ? head - kEventCapacity : 0;
+        dropped += first;
+        for (uint64_t i = first; i < head; ++i) {
+            const Event& e = b->events[i & (kEventCapacity - 1)];
+            const uint64_t start = e.start_ns.load(std::memory_order_relaxed);
+            const uint64_t dur = e.dur_ns.load(std::memory_order_relaxed);
+            const uint64_t sb = e.stage_bytes.load(std::memory_order_relaxed);
+            if (start < r.epoch_ns || (sb >> 56) >= kStageCount) continue;
+            const uint64_t ts = start - r.epoch_ns;
+            append(out, ",\n{\"name\":\"%s\",\"cat\":\"ota\",\"ph\":\"X\",\"pid\":%u,\"tid\":%u,"
+                        "\"ts\":%llu.%03u,\"dur\":%llu.%03u,\"args\":{\"bytes\":%llu}}",
+                   stage_name(Stage(sb >> 56)), pid, unsigned(b->tid),
+                   (unsigned long long)(ts / 1000), unsigned(ts % 1000),
+                   (unsigned long long)(dur / 1000), unsigned(dur % 1000),
+                   (unsigned long long)(sb & ((1ull << 56) - 1)));
+        }
+    }
+    out += "\n],\n\"otaStages\":{";
+    for (unsigned s = 0; s < kStageCount; ++s) {
+        const Summary& t = totals[s];
+        append(out, "%s\n\"%s\":{\"count\":%llu,\"bytes\":%llu,\"total_ns\":%llu,"
+                    "\"p50_ns\":%llu,\"p90_ns\":%llu,\"p99_ns\":%llu,\"max_ns\":%llu}",
+               s ? "," : "", stage_name(Stage(s)), (unsigned long long)t.count,
+               (unsigned long long)t.bytes, (unsigned long long)t.total_ns,
+               (unsigned long long)t.percentile(0.5), (unsigned long long)t.percentile(0.9),
+               (unsigned long long)t.percentile(0.99), (unsigned long long)t.max_ns);
+    }
+    append(out, "\n},\n\"otaDroppedEvents\":%llu}\n", (unsigned long long)dropped);
+
+    // 先写临时文件再改名, 重复导出时读者不会看到写了一半的文件
+    const std::string tmp = r.path + ".tmp";
+    {
+        FileDescriptor fd(tmp, O_WRONLY | O_CREAT | O_TRUNC);
+        fd.write_full(out.data(), out.size());
+    }
+    if (std::rename(tmp.c_str(), r.path.c_str()) != 0) throw io_error("cannot replace", r.path);
+
+    if (!summary) return;
+    std::fprintf(stderr, "%-10s %8s %10s %10s %9s %10s %10s %10s\n", "stage", "count", "MiB",
+                 "self_ms", "MiB/s", "p50_us", "p99_us", "max_us");
+    for (unsigned s = 0; s < kStageCount; ++s) {
+        const Summary& t = totals[s];
+        if (t.count == 0) continue;
+        const double mib = double(t.bytes) / double(1u << 20);
+        const double ms = double(t.total_ns) / 1e6;
+        std::fprintf(stderr, "%-10s %8llu %10.1f %10.1f %9.1f %10.1f %10.1f %10.1f\n",
+                     stage_name(Stage(s)), (unsigned long long)t.count, mib, ms,
+                     ms > 0 ? mib / (ms / 1e3) : 0.0, double(t.percentile(0.5)) / 1e3,
+                     double(t.percentile(0.99)) / 1e3, double(t.max_ns) / 1e3);
+    }
+    std::fprintf(stderr, "trace written to %s\n", r.path.c_str());
+}
+
+#else
+
+void trace_start(const std::string&) {
+    throw std::runtime_error("tracing is not compiled in (configure with -DOTA_TRACE=ON)");
+}
+
+void trace_dump(bool) {}
+
+#endif
+
+} // namespace ota
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// 各阶段耗时追踪。CMake 选项 OTA_TRACE=OFF 时 TraceSpan 为空类, 调用点全部编译消除;
+// 编译进来但未调用 trace_start 时每个区间只多一次 relaxed 原子读。
+//
+// 启用后每个线程独占一份直方图 (HDR 式对数分桶, 相对误差约 6%) 与计数器, 热路径上无锁无共享写;
+// 最近的区间另存入线程私有环形缓冲区, 导出为 Chrome trace / Perfetto 可读的 JSON。
+
+namespace ota {
+
+enum class Stage : uint8_t { Read, Verify, Decompress, Compress, Patch, Write, Sync };
+const unsigned kStageCount = 7;
+
+const char* stage_name(Stage stage);
+
+#if OTA_TRACE
+
+extern std::atomic<bool> g_trace_enabled;
+
+inline bool trace_enabled() { return g_trace_enabled.load(std::memory_order_relaxed); }
+
+// 计时区间。可嵌套: 直方图记录扣除子区间后的自身耗时, 各阶段之和即线程的总耗时。
+// 同一线程内须按后进先出的顺序结束。
+class TraceSpan {
+public:
+    TraceSpan() = default;
+    explicit TraceSpan(Stage stage, uint64_t bytes = 0) {
+        if (trace_enabled()) begin_slow(stage, bytes);
+    }
+    ~TraceSpan() { end(); }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    void begin(Stage stage, uint64_t bytes = 0) {
+        end();
+        if (trace_enabled()) begin_slow(stage, bytes);
+    }
+    void end() {
+        if (active_) end_slow();
+    }
+    bool active() const { return active_; }
+    void add_bytes(uint64_t n) { bytes_ += n; }
+
+private:
+    void begin_slow(Stage stage, uint64_t bytes);
+    void end_slow();
+
+    bool active_ = false;
+    Stage stage_ = Stage::Read;
+    uint64_t bytes_ = 0;
+    uint64_t start_ns_ = 0;
+    uint64_t child_ns_ = 0;
+    TraceSpan* parent_ = nullptr;
+};
+
+// 给当前线程在 trace 中的轨道命名
+void trace_thread_name(const char* name);
+
+#else
+
+inline bool trace_enabled() { return false; }
+
+class TraceSpan {
+public:
+    TraceSpan() = default;
+    explicit TraceSpan(Stage, uint64_t = 0) {}
+    void begin(Stage, uint64_t = 0) {}
+    void end() {}
+    bool active() const { return false; }
+    void add_bytes(uint64_t) {}
+};
+
+inline void trace_thread_name(const char*) {}
+
+#endif
+
+// 开启追踪: 退出时及收到 SIGUSR1 时把 trace 写到 path, 退出时另向 stderr 打印各阶段汇总。
+// 须在创建其他线程之前调用 (SIGUSR1 由专门的线程 sigwait 处理, 其余线程继承屏蔽字)。
+// 未编译追踪支持时抛异常。
+void trace_start(const std::string& path);
+
+// 立即导出一次 trace; summary 为真时同时打印汇总
+void trace_dump(bool summary);
+
+} // namespace ota
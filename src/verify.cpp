@@ -0,0 +1,29 @@
+#include "verify.h"
+
+#include <stdexcept>
+
+#include "mapped_file.h"
+#include "trace.h"
+
+namespace ota {
+
+Digest hash_image(const std::string& path, uint64_t chunk_size) {
+    if (chunk_size == 0) throw std::invalid_argument("chunk size must be non-zero");
+
+    MappedFile image(path);
+    image.advise_sequential();
+
+    Sha256 sha;
+    const uint64_t size = image.size();
+    for (uint64_t off = 0; off < size; off += chunk_size) {
+        const uint64_t len = (size - off < chunk_size) ? size - off : chunk_size;
+        // 处理当前块的同时让内核预读下一块
+        image.prefetch(off + len, chunk_size);
+        TraceSpan span(Stage::Verify, len);
+        sha.update(image.data() + off, size_t(len));
+        image.release(off, len);
+    }
+    return sha.finish();
+}
+
+} // namespace ota
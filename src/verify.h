@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "sha256.h"
+
+namespace ota {
+
+const uint64_t kDefaultVerifyChunk = 8ull << 20;
+
+// 以 mmap + 定长分块的方式计算整个镜像的 SHA-256, 常驻内存与镜像大小无关
+Digest hash_image(const std::string& path, uint64_t chunk_size = kDefaultVerifyChunk);
+
+} // namespace ota
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.h"
+#include "trace.h"
+
+namespace ota {
+
+// Chase-Lev 工作窃取双端队列 (定长, 元素为 u64)。
+// 所有者在底部压入/弹出 (LIFO, 缓存友好), 其他线程从顶部窃取 (取走最早压入、通常也是最大的任务)。
+class StealingDeque {
+public:
+    static const size_t kCapacity = 64;
+
+    StealingDeque() {
+        for (auto& c : cells_) c.store(0, std::memory_order_relaxed);
+    }
+
+    StealingDeque(const StealingDeque&) = delete;
+    StealingDeque& operator=(const StealingDeque&) = delete;
+
+    // 仅所有者调用; 队列满时返回 false
+    bool push(uint64_t value) {
+        const int64_t b = bottom_.load(std::memory_order_relaxed);
+        const int64_t t = top_.load(std::memory_order_acquire);
+        if (b - t >= int64_t(kCapacity)) return false;
+        cells_[size_t(b) & (kCapacity - 1)].store(value, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // 仅所有者调用
+    bool pop(uint64_t& value) {
+        const int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        if (t > b) {
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+        value = cells_[size_t(b) & (kCapacity - 1)].load(std::memory_order_relaxed);
+        if (t == b) {
+            // 只剩最后一个元素, 与窃取者竞争
+            const bool won = top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                                          std::memory_order_relaxed);
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    // 任意线程调用; 队列为空或竞争失败时返回 false
+    bool steal(uint64_t& value) {
+        int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t b = bottom_.load(std::memory_order_acquire);
+        if (t >= b) return false;
+        value = cells_[size_t(t) & (kCapacity - 1)].load(std::memory_order_relaxed);
+        return top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                            std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> cells_[kCapacity];
+    char pad0_[kCacheLine];
+    std::atomic<int64_t> top_{0};
+    char pad1_[kCacheLine - sizeof(std::atomic<int64_t>)];
+    std::atomic<int64_t> bottom_{0};
+    char pad2_[kCacheLine - sizeof(std::atomic<int64_t>)];
+};
+
+// 0 表示使用硬件线程数; pipeline / merkle / batch 共用
+inline unsigned resolve_threads(unsigned requested) {
+    if (requested > 0) return requested;
+    const unsigned hw = std::thread::hardware_concurrency();
+    return hw > 0 ? hw : 1;
+}
+
+// 用 threads 个线程 (含调用线程) 对 [0, n) 执行 fn(begin, end), n 须小于 2^32。
+// 每个线程把手中的区间不断对半拆分, 后一半压入自己的队列, 直到不超过 grain 后执行;
+// 自己的队列空了就随机挑一个线程窃取。拆分深度不超过 log2(n / grain), 队列不会溢出。
+// fn 抛出的第一个异常在所有线程退出后重新抛出。
+template <typename Fn>
+void parallel_for(uint64_t n, uint64_t grain, unsigned threads, Fn fn,
+                  const char* thread_name = "worker") {
+    if (n >= (1ull << 32)) throw std::invalid_argument("parallel_for range too large");
+    if (n == 0) return;
+    if (grain == 0) grain = 1;
+    threads = resolve_threads(threads);
+    if (uint64_t(threads) > (n + grain - 1) / grain) threads = unsigned((n + grain - 1) / grain);
+
+    std::unique_ptr<StealingDeque[]> deques(new StealingDeque[threads]);
+    std::atomic<uint64_t> done{0};
+    std::atomic<bool> failed{false};
+    std::mutex error_mu;
+    std::exception_ptr error;
+
+    auto pack = [](uint64_t begin, uint64_t end) { return (begin << 32) | end; };
+    deques[0].push(pack(0, n));
+
+    auto run = [&](unsigned self) {
+        StealingDeque& own = deques[self];
+        uint64_t rng = 0x9E3779B97F4A7C15ull * (self + 1);
+        Backoff backoff;
+        while (done.load(std::memory_order_acquire) < n && !failed.load(std::memory_order_relaxed)) {
+            uint64_t range = 0;
+            bool got = own.pop(range);
+            for (unsigned i = 1; !got && i < threads; ++i) {
+                rng ^= rng << 13;
+                rng ^= rng >> 7;
+                rng ^= rng << 17;
+                const unsigned victim = unsigned(rng % threads);
+                if (victim != self) got = deques[victim].steal(range);
+            }
+            if (!got) {
+                backoff.pause();
+                continue;
+            }
+            backoff.reset();
+
+            uint64_t begin = range >> 32;
+            uint64_t end = range & 0xFFFFFFFFull;
+            while (end - begin > grain) {
+                const uint64_t mid = begin + (end - begin) / 2;
+                if (!own.push(pack(mid, end))) break;
+                end = mid;
+            }
+            try {
+                fn(begin, end);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mu);
+                if (!error) error = std::current_exception();
+                failed.store(true, std::memory_order_relaxed);
+            }
+            done.fetch_add(end - begin, std::memory_order_release);
+        }
+    };
+
+    std::vector<std::thread> helpers;
+    for (unsigned t = 1; t < threads; ++t) {
+        helpers.emplace_back([&run, t, thread_name] {
+            trace_thread_name(thread_name);
+            run(t);
+        });
+    }
+    run(0);
+    for (std::thread& h : helpers) h.join();
+    if (error) std::rethrow_exception(error);
+}
+
+} // namespace ota
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "base_cache.h"
+#include "batch.h"
+#include "pipeline.h"
+#include "test_util.h"
+
+namespace ota {
+namespace {
+
+const size_t kChunk = 64 << 10;
+const size_t kImage = 16 * kChunk + 1000;  // 最后一块不满
+
+// 可压缩的基础镜像: 随机数据中夹杂大段重复
+std::vector<uint8_t> base_image() {
+    std::vector<uint8_t> img = test::random_bytes(kImage, 21);
+    for (size_t i = 0; i < kImage; ++i) {
+        if ((i / 4096) % 2 == 0) img[i] = uint8_t(i % 251);
+    }
+    return img;
+}
+
+class BatchTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        base_ = base_image();
+        test::write_file(dir_.file("base.img"), base_);
+        PipelineOptions popts;
+        popts.chunk_size = kChunk;
+        compress_file(dir_.file("base.img"), dir_.file("base.lz"), popts);
+    }
+
+    // 生成第 k 个变体及其补丁, 返回一个以压缩镜像为基础的任务
+    BatchJob make_job(int k) {
+        std::vector<uint8_t> img = base_;
+        for (size_t i = size_t(k) * 977; i < img.size(); i += 5003) img[i] ^= uint8_t(k + 1);
+        const std::string name = "sku" + std::to_string(k);
+        test::write_file(dir_.file(name + ".img"), img);
+        delta_diff(dir_.file("base.img"), dir_.file(name + ".img"), dir_.file(name + ".delta"));
+        images_.push_back(img);
+
+        BatchJob job;
+        job.base = dir_.file("base.lz");
+        job.patch = dir_.file(name + ".delta");
+        job.out = dir_.file(name + ".out");
+        return job;
+    }
+
+    test::TempDir dir_;
+    std::vector<uint8_t> base_;
+    std::vector<std::vector<uint8_t>> images_;
+};
+
+TEST_F(BatchTest, CacheDecodesEachChunkOnceAcrossThreads) {
+    const CompressedImage image(dir_.file("base.lz"));
+    ASSERT_EQ(image.chunk_count(), 17u);
+    BlockCache cache(kChunk, image.chunk_count());
+
+    std::atomic<bool> mismatch{false};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t] {
+            CachedBase reader(image, 0, cache);
+            // 各线程从不同位置开始, 同一块常被同时请求
+            for (uint64_t n = 0; n < image.chunk_count(); ++n) {
+                const uint64_t block = (n + uint64_t(t) * 5) % image.chunk_count();
+                const uint64_t off = block * kChunk + 7;
+                size_t len = 0;
+                const uint8_t* p = reader.view(off, &len);
+                if (len != std::min<uint64_t>(kChunk, kImage - block * kChunk) - 7 ||
+                    std::memcmp(p, base_.data() + off, len) != 0) {
+                    mismatch = true;
+                }
+            }
+        });
+    }
+    for (std::thread& t : threads) t.join();
+
+    EXPECT_FALSE(mismatch);
+    const BlockCacheStats st = cache.stats();
+    EXPECT_EQ(st.decoded, image.chunk_count());
+    EXPECT_EQ(st.evictions, 0u);
+    EXPECT_EQ(st.hits + st.waits, 4 * image.chunk_count() - st.decoded);
+}
+
+TEST_F(BatchTest, CacheEvictsUnpinnedBlocksWhenFull) {
+    const CompressedImage image(dir_.file("base.lz"));
+    BlockCache cache(kChunk, 3);  // 两个线程各引用一块, 至少留一块可淘汰
+
+    std::atomic<bool> mismatch{false};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 2; ++t) {
+        threads.emplace_back([&, t] {
+            CachedBase reader(image, 0, cache);
+            for (int round = 0; round < 3; ++round) {
+                for (uint64_t n = 0; n < image.chunk_count(); ++n) {
+                    const uint64_t block = t ? image.chunk_count() - 1 - n : n;
+                    size_t len = 0;
+                    const uint8_t* p = reader.view(block * kChunk, &len);
+                    if (std::memcmp(p, base_.data() + block * kChunk, len) != 0) mismatch = true;
+                }
+            }
+        });
+    }
+    for (std::thread& t : threads) t.join();
+
+    EXPECT_FALSE(mismatch);
+    const BlockCacheStats st = cache.stats();
+    EXPECT_GT(st.evictions, 0u);
+    EXPECT_GT(st.decoded, image.chunk_count());
+}
+
+TEST_F(BatchTest, RunsJobsOnSharedCacheAndIsolatesFailures) {
+    std::vector<BatchJob> jobs;
+    for (int k = 0; k < 4; ++k) jobs.push_back(make_job(k));
+    jobs[2].patch = dir_.file("missing.delta");
+
+    BatchOptions opts;
+    opts.threads = 4;
+    opts.apply.block_size = kChunk;
+    opts.apply.mem_limit = 4u << 20;
+    std::vector<BatchJobResult> results;
+    const BatchStats st = run_batch(jobs, opts, &results);
+
+    EXPECT_EQ(st.jobs, 4u);
+    EXPECT_EQ(st.failed, 1u);
+    EXPECT_EQ(st.compressed_bases, 1u);
+    EXPECT_EQ(st.cache.decoded, 17u);
+    ASSERT_EQ(results.size(), 4u);
+    for (int k = 0; k < 4; ++k) {
+        if (k == 2) {
+            EXPECT_FALSE(results[k].ok);
+            EXPECT_NE(results[k].error.find("missing.delta"), std::string::npos)
+                << results[k].error;
+            continue;
+        }
+        EXPECT_TRUE(results[k].ok) << results[k].error;
+        EXPECT_TRUE(test::read_file(jobs[k].out) == images_[k]) << "job " << k;
+    }
+}
+
+void write_manifest(const test::TempDir& dir, const std::string& jobs) {
+    const std::string text = "{\"jobs\": [" + jobs + "]}";
+    test::write_file(dir.file("jobs.json"), std::vector<uint8_t>(text.begin(), text.end()));
+}
+
+TEST(BatchManifestTest, ResolvesPathsAgainstManifestDirectory) {
+    test::TempDir dir;
+    write_manifest(dir, R"({"base": "b.img", "patch": "1.delta", "out": "1.img", "journal": "1.jnl"},
+                        {"base": "/abs/b.img", "patch": "2.delta", "out": "2.img"})");
+    BatchOptions opts;
+    const std::vector<BatchJob> jobs = load_batch_manifest(dir.file("jobs.json"), &opts);
+    ASSERT_EQ(jobs.size(), 2u);
+    EXPECT_EQ(jobs[0].out, dir.file("1.img"));
+    EXPECT_EQ(jobs[0].journal, dir.file("1.jnl"));
+    EXPECT_EQ(jobs[1].base, "/abs/b.img");
+    EXPECT_TRUE(jobs[1].journal.empty());
+}
+
+TEST(BatchManifestTest, RejectsFilesWrittenByTwoJobs) {
+    test::TempDir dir;
+    BatchOptions opts;
+    const char* cases[] = {
+        // 同一输出, 路径写法不同
+        R"({"base": "b.img", "patch": "1.delta", "out": "x.img"},
+           {"base": "b.img", "patch": "2.delta", "out": "./x.img"})",
+        // 共用日志
+        R"({"base": "b.img", "patch": "1.delta", "out": "1.img", "journal": "j"},
+           {"base": "b.img", "patch": "2.delta", "out": "2.img", "journal": "j"})",
+        // 一个任务的输出是另一个任务的日志
+        R"({"base": "b.img", "patch": "1.delta", "out": "1.img", "journal": "2.img"},
+           {"base": "b.img", "patch": "2.delta", "out": "2.img"})",
+        // 输出覆盖另一个任务的基础镜像
+        R"({"base": "b.img", "patch": "1.delta", "out": "1.img"},
+           {"base": "1.img", "patch": "2.delta", "out": "2.img"})",
+    };
+    for (const char* jobs : cases) {
+        write_manifest(dir, jobs);
+        EXPECT_THROW(load_batch_manifest(dir.file("jobs.json"), &opts), std::runtime_error) << jobs;
+    }
+}
+
+} // namespace
+} // namespace ota
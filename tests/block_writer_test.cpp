@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "block_writer.h"
+#include "test_util.h"
+
+namespace ota {
+namespace {
+
+using Backend = WriterOptions::Backend;
+
+// 参数: 后端, 是否 O_DIRECT
+class BlockWriterTest : public ::testing::TestWithParam<std::tuple<Backend, bool>> {
+protected:
+    void SetUp() override {
+        opts_.backend = std::get<0>(GetParam());
+        opts_.direct = std::get<1>(GetParam());
+        opts_.queue_depth = 3;
+        opts_.buffer_size = 16 << 10;
+        opts_.fsync_interval = 32 << 10;  // 写出过程中也会落盘
+        if (opts_.backend == Backend::Uring) {
+            try {
+                BlockWriter probe(dir_.file("probe"), opts_);
+            } catch (const std::runtime_error& e) {
+                GTEST_SKIP() << e.what();
+            }
+        }
+    }
+
+    // 交替使用 write 与 space/commit, 每次写入长度不一, 跨过缓冲区边界
+    void write_all(BlockWriter& w, const std::vector<uint8_t>& data) {
+        size_t off = 0;
+        for (size_t step = 1; off < data.size(); step = step * 7 % 20011 + 1) {
+            size_t n = std::min(step, data.size() - off);
+            if (step % 2) {
+                w.write(data.data() + off, n);
+            } else {
+                size_t avail = 0;
+                uint8_t* dst = w.space(&avail);
+                n = std::min(n, avail);
+                std::copy(data.begin() + off, data.begin() + off + n, dst);
+                w.commit(n);
+            }
+            off += n;
+        }
+    }
+
+    test::TempDir dir_;
+    WriterOptions opts_;
+};
+
+TEST_P(BlockWriterTest, WritesFileWithUnalignedTail) {
+    const std::vector<uint8_t> data = test::random_bytes(5 * (16 << 10) + 3 * 4096 + 123, 1);
+    // 已有的更长文件应被截断
+    test::write_file(dir_.file("out"), test::random_bytes(data.size() * 2, 2));
+
+    BlockWriter w(dir_.file("out"), opts_);
+    write_all(w, data);
+    EXPECT_EQ(w.offset(), data.size());
+    w.finish();
+    EXPECT_EQ(w.durable_offset(), data.size());
+
+    const std::vector<uint8_t> out = test::read_file(dir_.file("out"));
+    EXPECT_EQ(out.size(), data.size());
+    EXPECT_TRUE(out == data);
+}
+
+TEST_P(BlockWriterTest, ContinuesFromStartOffset) {
+    // O_DIRECT 续写偏移须 4 KiB 对齐
+    const uint64_t start = opts_.direct ? 8192 : 1000;
+    std::vector<uint8_t> expected = test::random_bytes(64 << 10, 3);
+    test::write_file(dir_.file("out"), expected);
+
+    const std::vector<uint8_t> data = test::random_bytes(50000, 4);
+    BlockWriter w(dir_.file("out"), opts_, start);
+    write_all(w, data);
+    EXPECT_EQ(w.offset(), start + data.size());
+    w.finish();
+    EXPECT_EQ(w.durable_offset(), start + data.size());
+
+    // 偏移之前的内容保留, 之后的旧数据被覆盖或截掉
+    expected.resize(size_t(start));
+    expected.insert(expected.end(), data.begin(), data.end());
+    const std::vector<uint8_t> out = test::read_file(dir_.file("out"));
+    EXPECT_EQ(out.size(), expected.size());
+    EXPECT_TRUE(out == expected);
+}
+
+TEST_P(BlockWriterTest, WritesTailShorterThanOneBlock) {
+    for (size_t n : {size_t(1), size_t(4095), size_t(4097)}) {
+        const std::vector<uint8_t> data = test::random_bytes(n, n);
+        BlockWriter w(dir_.file("out"), opts_);
+        w.write(data.data(), data.size());
+        w.finish();
+        EXPECT_TRUE(test::read_file(dir_.file("out")) == data) << "size " << n;
+    }
+}
+
+std::string param_name(const ::testing::TestParamInfo<std::tuple<Backend, bool>>& info) {
+    return std::string(std::get<0>(info.param) == Backend::Uring ? "Uring" : "Pwrite") +
+           (std::get<1>(info.param) ? "Direct" : "Buffered");
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends, BlockWriterTest,
+                         ::testing::Combine(::testing::Values(Backend::Pwrite, Backend::Uring),
+                                            ::testing::Bool()),
+                         param_name);
+
+} // namespace
+} // namespace ota
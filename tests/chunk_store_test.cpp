@@ -0,0 +1,111 @@
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include "chunk_store.h"
+#include "test_util.h"
+
+namespace ota {
+namespace {
+
+const uint32_t kChunk = 1000;
+
+std::vector<uint8_t> chunk(uint64_t seed) { return test::random_bytes(kChunk, seed); }
+
+Digest digest_of(const std::vector<uint8_t>& data) { return Sha256::hash(data.data(), data.size()); }
+
+TEST(ChunkStoreTest, RewritesEntryPointingPastPackEnd) {
+    test::TempDir dir;
+    const std::string store_dir = dir.file("store");
+    const std::vector<uint8_t> a = chunk(1), b = chunk(2);
+    {
+        ChunkStore store(store_dir);
+        EXPECT_TRUE(store.put(digest_of(a), a.data(), kChunk));
+        EXPECT_TRUE(store.put(digest_of(b), b.data(), kChunk));
+        store.flush();
+    }
+    // 模拟索引已落盘而 pack 尾部丢失
+    ASSERT_EQ(::truncate(dir.file("store/chunks.pack").c_str(), kChunk + kChunk / 2), 0);
+
+    ChunkStore store(store_dir);
+    EXPECT_TRUE(store.contains(digest_of(a)));
+    EXPECT_FALSE(store.contains(digest_of(b)));
+    uint32_t len = 0;
+    EXPECT_EQ(store.get(digest_of(b), &len), nullptr);
+
+    EXPECT_TRUE(store.put(digest_of(b), b.data(), kChunk));
+    EXPECT_EQ(store.chunk_count(), 2u);
+    const uint8_t* data = store.get(digest_of(b), &len);
+    ASSERT_NE(data, nullptr);
+    EXPECT_TRUE(std::vector<uint8_t>(data, data + len) == b);
+}
+
+TEST(ChunkStoreTest, RewritesLostChunkAfterPackGrowsPastIt) {
+    test::TempDir dir;
+    const std::string store_dir = dir.file("store");
+    const std::vector<uint8_t> a = chunk(1), b = chunk(2), c = chunk(3);
+    {
+        ChunkStore store(store_dir);
+        store.put(digest_of(a), a.data(), kChunk);
+        store.put(digest_of(b), b.data(), kChunk);
+        store.flush();
+    }
+    ASSERT_EQ(::truncate(dir.file("store/chunks.pack").c_str(), kChunk + kChunk / 2), 0);
+    {
+        // 之后追加的块会覆盖 b 原来的偏移, b 的旧条目不能因此被当作有效
+        ChunkStore store(store_dir);
+        EXPECT_TRUE(store.put(digest_of(c), c.data(), kChunk));
+        store.flush();
+    }
+
+    ChunkStore store(store_dir);
+    EXPECT_FALSE(store.contains(digest_of(b)));
+    EXPECT_TRUE(store.put(digest_of(b), b.data(), kChunk));
+    for (const std::vector<uint8_t>* v : {&a, &b, &c}) {
+        uint32_t len = 0;
+        const uint8_t* data = store.get(digest_of(*v), &len);
+        ASSERT_NE(data, nullptr);
+        EXPECT_TRUE(std::vector<uint8_t>(data, data + len) == *v);
+    }
+}
+
+TEST(ChunkStoreTest, DropsChunksWrittenAfterLastFlush) {
+    test::TempDir dir;
+    const std::string store_dir = dir.file("store");
+    const std::vector<uint8_t> a = chunk(1), b = chunk(2);
+    {
+        ChunkStore store(store_dir);
+        store.put(digest_of(a), a.data(), kChunk);
+        store.flush();
+        store.put(digest_of(b), b.data(), kChunk);  // 未 flush 即 "崩溃"
+    }
+
+    ChunkStore store(store_dir);
+    EXPECT_EQ(store.pack_size(), kChunk);
+    EXPECT_EQ(store.chunk_count(), 1u);
+    EXPECT_TRUE(store.contains(digest_of(a)));
+    EXPECT_FALSE(store.contains(digest_of(b)));
+}
+
+TEST(ChunkStoreTest, GetRejectsChunkNotMatchingDigest) {
+    test::TempDir dir;
+    const std::string store_dir = dir.file("store");
+    const std::vector<uint8_t> a = chunk(1);
+    {
+        ChunkStore store(store_dir);
+        store.put(digest_of(a), a.data(), kChunk);
+        store.flush();
+    }
+    std::vector<uint8_t> pack = test::read_file(dir.file("store/chunks.pack"));
+    pack[kChunk / 2] ^= 0x01;
+    test::write_file(dir.file("store/chunks.pack"), pack);
+
+    ChunkStore store(store_dir);
+    uint32_t len = 0;
+    EXPECT_THROW(store.get(digest_of(a), &len), std::runtime_error);
+}
+
+} // namespace
+} // namespace ota
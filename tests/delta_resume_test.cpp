@@ -0,0 +1,101 @@
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include "delta.h"
+#include "test_util.h"
+
+namespace ota {
+namespace {
+
+const size_t kBlock = 4096;
+
+class DeltaResumeTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        base_ = test::random_bytes(512 << 10, 1);
+        // 零散改动加一段插入, 补丁中同时有 diff 与 extra 数据
+        image_ = base_;
+        for (size_t i = 0; i < image_.size(); i += 3001) image_[i] ^= 0x5a;
+        const std::vector<uint8_t> inserted = test::random_bytes(20 << 10, 2);
+        image_.insert(image_.begin() + (200 << 10), inserted.begin(), inserted.end());
+
+        test::write_file(dir_.file("base.img"), base_);
+        test::write_file(dir_.file("new.img"), image_);
+        delta_diff(dir_.file("base.img"), dir_.file("new.img"), dir_.file("p.delta"));
+
+        opts_.block_size = kBlock;
+        opts_.writer.fsync_interval = kBlock;  // 每块落盘, 日志逐块推进
+        opts_.journal_path = dir_.file("apply.jnl");
+    }
+
+    // 用截掉末尾的补丁应用一次, 模拟中途断电: 已落盘的块留在日志中
+    void interrupted_apply() {
+        const std::vector<uint8_t> patch = test::read_file(dir_.file("p.delta"));
+        test::write_file(dir_.file("cut.delta"),
+                         std::vector<uint8_t>(patch.begin(), patch.end() - 16));
+        EXPECT_THROW(delta_apply(dir_.file("base.img"), dir_.file("cut.delta"),
+                                 dir_.file("out.img"), opts_),
+                     std::runtime_error);
+        ASSERT_EQ(::access(opts_.journal_path.c_str(), F_OK), 0);
+    }
+
+    DeltaApplyStats apply() {
+        return delta_apply(dir_.file("base.img"), dir_.file("p.delta"), dir_.file("out.img"),
+                           opts_);
+    }
+
+    void expect_output_matches() {
+        EXPECT_TRUE(test::read_file(dir_.file("out.img")) == image_);
+        EXPECT_NE(::access(opts_.journal_path.c_str(), F_OK), 0) << "journal left behind";
+    }
+
+    test::TempDir dir_;
+    std::vector<uint8_t> base_;
+    std::vector<uint8_t> image_;
+    DeltaApplyOptions opts_;
+};
+
+TEST_F(DeltaResumeTest, ResumesAfterInterruption) {
+    interrupted_apply();
+    const DeltaApplyStats st = apply();
+    EXPECT_GT(st.resumed_from, 0u);
+    EXPECT_LT(st.resumed_from, image_.size());
+    EXPECT_EQ(st.resumed_from % kBlock, 0u);
+    expect_output_matches();
+}
+
+TEST_F(DeltaResumeTest, RewritesFromCorruptedPrefixBlock) {
+    interrupted_apply();
+    // 篡改已完成的第 2 块, 续传应退回到该块
+    std::vector<uint8_t> out = test::read_file(dir_.file("out.img"));
+    ASSERT_GT(out.size(), 3 * kBlock);
+    out[2 * kBlock + 100] ^= 0xff;
+    test::write_file(dir_.file("out.img"), out);
+
+    const DeltaApplyStats st = apply();
+    EXPECT_EQ(st.resumed_from, 2 * kBlock);
+    expect_output_matches();
+}
+
+TEST_F(DeltaResumeTest, RetriesFromStartAfterDigestMismatch) {
+    // 大小相同但内容错误的基础镜像: 补丁能完整解析, 只有摘要不符
+    test::write_file(dir_.file("wrong.img"), test::random_bytes(base_.size(), 3));
+    try {
+        delta_apply(dir_.file("wrong.img"), dir_.file("p.delta"), dir_.file("out.img"), opts_);
+        FAIL() << "expected digest mismatch";
+    } catch (const std::runtime_error& e) {
+        EXPECT_NE(std::string(e.what()).find("digest mismatch"), std::string::npos) << e.what();
+    }
+
+    const DeltaApplyStats st = apply();
+    EXPECT_EQ(st.resumed_from, 0u);
+    expect_output_matches();
+}
+
+} // namespace
+} // namespace ota
@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "lz4_block.h"
+#include "pipeline.h"
+#include "test_util.h"
+
+namespace ota {
+namespace {
+
+size_t bound(size_t n) { return n + n / 255 + 16; }
+
+// 压缩后按原长解压, 比较内容; 返回压缩后长度
+size_t round_trip(const std::vector<uint8_t>& raw) {
+    std::vector<uint8_t> packed(bound(raw.size()));
+    const size_t n = lz4_compress(raw.data(), raw.size(), packed.data(), packed.size());
+    EXPECT_GT(n, 0u) << "size " << raw.size();
+    std::vector<uint8_t> out(raw.size() + 1);
+    EXPECT_EQ(lz4_decompress(packed.data(), n, out.data(), raw.size()), raw.size())
+        << "size " << raw.size();
+    out.resize(raw.size());
+    EXPECT_TRUE(out == raw) << "size " << raw.size();
+    return n;
+}
+
+std::vector<uint8_t> periodic(size_t n, size_t period) {
+    std::vector<uint8_t> out(n);
+    for (size_t i = 0; i < n; ++i) out[i] = uint8_t('a' + i % period);
+    return out;
+}
+
+TEST(Lz4Test, Empty) {
+    round_trip({});
+}
+
+TEST(Lz4Test, ShorterThanMinimumMatchBlock) {
+    // 13 字节以下整块都是字面量
+    for (size_t n = 1; n < 13; ++n) {
+        round_trip(test::random_bytes(n, n));
+        round_trip(std::vector<uint8_t>(n, 'x'));
+    }
+}
+
+TEST(Lz4Test, Incompressible) {
+    const std::vector<uint8_t> raw = test::random_bytes(256 << 10, 7);
+    EXPECT_GE(round_trip(raw), raw.size());
+
+    // 输出放不下时返回 0, 调用方改为原样存储
+    std::vector<uint8_t> packed(raw.size());
+    EXPECT_EQ(lz4_compress(raw.data(), raw.size(), packed.data(), packed.size()), 0u);
+}
+
+TEST(Lz4Test, LongOverlappingRuns) {
+    // 偏移小于匹配长度, 解压时源与目标重叠; 长度跨过 15 / 15+255 的变长编码边界
+    for (size_t period : {1, 2, 3, 7, 16}) {
+        for (size_t n : {19, 20, 270, 273, 274, 529, 4096, 1 << 20}) {
+            const size_t packed = round_trip(periodic(n, period));
+            if (n >= 4096) {
+                EXPECT_LT(packed, n / 50);
+            }
+        }
+    }
+}
+
+TEST(Lz4Test, AllSmallSizes) {
+    // 字面量与匹配长度在各个编码边界附近的所有组合
+    const std::vector<uint8_t> noise = test::random_bytes(600, 11);
+    for (size_t n = 0; n <= 600; ++n) {
+        std::vector<uint8_t> raw(noise.begin(), noise.begin() + n);
+        for (size_t i = n / 2; i < n; ++i) raw[i] = raw[i - n / 2];
+        round_trip(raw);
+    }
+}
+
+TEST(Lz4Test, MatchesAtMaximumOffset) {
+    std::vector<uint8_t> raw = test::random_bytes(200 << 10, 13);
+    std::memcpy(raw.data() + 65535 + 1000, raw.data() + 1000, 4096);
+    std::memcpy(raw.data() + 65536 + 9000, raw.data() + 9000, 4096);
+    round_trip(raw);
+}
+
+TEST(Lz4Test, RejectsCorruptInput) {
+    const std::vector<uint8_t> raw = periodic(10000, 5);
+    std::vector<uint8_t> packed(bound(raw.size()));
+    const size_t n = lz4_compress(raw.data(), raw.size(), packed.data(), packed.size());
+    ASSERT_GT(n, 0u);
+    std::vector<uint8_t> out(raw.size());
+    EXPECT_EQ(lz4_decompress(packed.data(), n - 1, out.data(), out.size()), SIZE_MAX);
+    EXPECT_EQ(lz4_decompress(packed.data(), n, out.data(), out.size() - 1), SIZE_MAX);
+    // 匹配偏移指向输出起点之前
+    const uint8_t bad_offset[] = {0x14, 'a', 0x05, 0x00, 0x50, 'b', 'c', 'd', 'e', 'f'};
+    EXPECT_EQ(lz4_decompress(bad_offset, sizeof(bad_offset), out.data(), out.size()), SIZE_MAX);
+}
+
+// 以下压缩数据由 liblz4 1.9.4 的 LZ4_compress_default 生成
+TEST(Lz4Test, DecodesLiblz4Blocks) {
+    const uint8_t empty[] = {0x00};
+    uint8_t dst[8];
+    EXPECT_EQ(lz4_decompress(empty, sizeof(empty), dst, sizeof(dst)), 0u);
+
+    const uint8_t hello[] = {0x50, 'h', 'e', 'l', 'l', 'o'};
+    ASSERT_EQ(lz4_decompress(hello, sizeof(hello), dst, sizeof(dst)), 5u);
+    EXPECT_EQ(std::memcmp(dst, "hello", 5), 0);
+
+    const uint8_t packed[] = {
+        0xff, 0x21, 0x4f, 0x54, 0x41, 0x20, 0x72, 0x65, 0x66, 0x65, 0x72, 0x65,
+        0x6e, 0x63, 0x65, 0x20, 0x62, 0x6c, 0x6f, 0x63, 0x6b, 0x2c, 0x20, 0x70,
+        0x72, 0x6f, 0x64, 0x75, 0x63, 0x65, 0x64, 0x20, 0x62, 0x79, 0x20, 0x6c,
+        0x69, 0x62, 0x6c, 0x7a, 0x34, 0x20, 0x31, 0x2e, 0x39, 0x2e, 0x34, 0x2e,
+        0x20, 0x7a, 0x01, 0x00, 0xff, 0x19, 0xaf, 0x30, 0x31, 0x32, 0x33, 0x34,
+        0x35, 0x36, 0x37, 0x38, 0x39, 0x0a, 0x00, 0xab, 0x0f, 0x23, 0x02, 0x02,
+        0xc0, 0x65, 0x6e, 0x64, 0x20, 0x6f, 0x66, 0x20, 0x64, 0x61, 0x74, 0x61,
+        0x2e,
+    };
+    std::string expected = "OTA reference block, produced by liblz4 1.9.4. ";
+    expected += std::string(300, 'z');
+    for (int i = 0; i < 20; ++i) expected += "0123456789";
+    expected += "OTA reference block, end of data.";
+
+    std::vector<uint8_t> out(expected.size());
+    ASSERT_EQ(lz4_decompress(packed, sizeof(packed), out.data(), out.size()), expected.size());
+    EXPECT_EQ(std::string(out.begin(), out.end()), expected);
+}
+
+class Lz4FrameTest : public ::testing::TestWithParam<unsigned> {};
+
+TEST_P(Lz4FrameTest, RoundTripsAtEveryChunkBoundary) {
+    const size_t chunk = 64 << 10;
+    test::TempDir dir;
+    PipelineOptions opts;
+    opts.chunk_size = chunk;
+    opts.threads = GetParam();
+    for (size_t n : {size_t(0), size_t(1), chunk - 1, chunk, chunk + 1, 2 * chunk, 3 * chunk - 1,
+                     5 * chunk + 13}) {
+        // 可压缩与不可压缩的块交替, 帧中同时有压缩块与原样存储块
+        std::vector<uint8_t> raw = test::random_bytes(n, n);
+        for (size_t off = 0; off < n; off += 2 * chunk) {
+            const size_t len = std::min(chunk, n - off);
+            const std::vector<uint8_t> run = periodic(len, 9);
+            std::copy(run.begin(), run.end(), raw.begin() + off);
+        }
+        test::write_file(dir.file("raw"), raw);
+        const PipelineStats c = compress_file(dir.file("raw"), dir.file("raw.lz"), opts);
+        EXPECT_EQ(c.chunks, (n + chunk - 1) / chunk);
+        decompress_file(dir.file("raw.lz"), dir.file("out"), opts);
+        EXPECT_TRUE(test::read_file(dir.file("out")) == raw) << "size " << n;
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(Threads, Lz4FrameTest, ::testing::Values(1u, 4u));
+
+} // namespace
+} // namespace ota
@@ -0,0 +1,127 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "merkle.h"
+#include "test_util.h"
+
+namespace ota {
+namespace {
+
+const uint32_t kBlock = 64;
+
+// 按 merkle.h 中的定义独立计算根, 与清单互相印证
+Digest reference_root(const std::vector<uint8_t>& image, uint32_t block_size) {
+    std::vector<Digest> level;
+    for (uint64_t off = 0; off < image.size() || level.empty(); off += block_size) {
+        const size_t len = size_t(std::min<uint64_t>(block_size, image.size() - off));
+        std::vector<uint8_t> leaf(1, 0x00);
+        leaf.insert(leaf.end(), image.begin() + off, image.begin() + off + len);
+        level.push_back(Sha256::hash(leaf.data(), leaf.size()));
+    }
+    while (level.size() > 1) {
+        std::vector<Digest> above;
+        for (size_t i = 0; i < level.size(); i += 2) {
+            if (i + 1 == level.size()) {
+                above.push_back(level[i]);
+                continue;
+            }
+            uint8_t buf[65];
+            buf[0] = 0x01;
+            std::memcpy(buf + 1, level[i].data(), 32);
+            std::memcpy(buf + 33, level[i + 1].data(), 32);
+            above.push_back(Sha256::hash(buf, sizeof(buf)));
+        }
+        level.swap(above);
+    }
+    return level[0];
+}
+
+class MerkleTest : public ::testing::Test {
+protected:
+    // 生成 size 字节的镜像及其清单
+    MerkleManifest build(size_t size, uint64_t seed = 1) {
+        image_ = test::random_bytes(size, seed);
+        test::write_file(dir_.file("image"), image_);
+        const ManifestStats st =
+            build_manifest(dir_.file("image"), dir_.file("image.mkl"), kBlock, 2);
+        EXPECT_EQ(st.root, reference_root(image_, kBlock)) << "size " << size;
+        return MerkleManifest(dir_.file("image.mkl"));
+    }
+
+    bool verify(const MerkleManifest& m, uint64_t first, uint64_t count,
+                uint64_t* hashes = nullptr) {
+        return m.verify_range(first, count, image_.data() + first * kBlock, hashes);
+    }
+
+    test::TempDir dir_;
+    std::vector<uint8_t> image_;
+};
+
+TEST_F(MerkleTest, VerifiesEveryRangeForAllLeafCounts) {
+    // 包含奇数叶子数 (逐层出现落单节点) 以及不满一块的末块
+    for (uint64_t leaves = 1; leaves <= 64; ++leaves) {
+        const size_t size = size_t(leaves * kBlock - (leaves % 3) * 7);
+        const MerkleManifest m = build(size, leaves);
+        ASSERT_EQ(m.leaf_count(), leaves);
+        uint32_t levels = 1;
+        while ((1ull << (levels - 1)) < leaves) ++levels;
+        for (uint64_t first = 0; first < leaves; ++first) {
+            for (uint64_t count = 1; first + count <= leaves; ++count) {
+                uint64_t hashes = 0;
+                EXPECT_TRUE(verify(m, first, count, &hashes))
+                    << "leaves " << leaves << " range " << first << "+" << count;
+                EXPECT_LE(hashes, 2 * count + 2 * levels);
+            }
+        }
+    }
+}
+
+TEST_F(MerkleTest, VerifiesLastShortBlockFromImage) {
+    const MerkleManifest m = build(10 * kBlock + 1);
+    ASSERT_EQ(m.leaf_count(), 11u);
+    EXPECT_TRUE(verify_blocks(dir_.file("image"), m, 10, 1));
+    EXPECT_TRUE(verify_blocks(dir_.file("image"), m, 7, 4));
+    EXPECT_THROW(verify_blocks(dir_.file("image"), m, 10, 2), std::invalid_argument);
+    EXPECT_THROW(verify(m, 11, 1), std::invalid_argument);
+    EXPECT_THROW(verify(m, 0, 0), std::invalid_argument);
+}
+
+TEST_F(MerkleTest, SingleLeafImages) {
+    for (size_t size : {size_t(0), size_t(1), size_t(kBlock - 1), size_t(kBlock)}) {
+        const MerkleManifest m = build(size);
+        ASSERT_EQ(m.leaf_count(), 1u) << "size " << size;
+        uint64_t hashes = 0;
+        EXPECT_TRUE(verify(m, 0, 1, &hashes)) << "size " << size;
+        EXPECT_EQ(hashes, 1u);
+        if (size > 0) {
+            image_[size - 1] ^= 0x01;
+            EXPECT_FALSE(verify(m, 0, 1)) << "size " << size;
+        }
+    }
+}
+
+TEST_F(MerkleTest, RejectsTamperedBlock) {
+    for (uint64_t leaves : {2u, 7u, 33u}) {
+        const MerkleManifest m = build(size_t(leaves * kBlock - 5), leaves);
+        for (uint64_t bad : {uint64_t(0), leaves / 2, leaves - 1}) {
+            image_[bad * kBlock + 3] ^= 0x80;
+            for (uint64_t first = 0; first < leaves; ++first) {
+                for (uint64_t count = 1; first + count <= leaves; ++count) {
+                    const bool covers = first <= bad && bad < first + count;
+                    EXPECT_EQ(verify(m, first, count), !covers)
+                        << "leaves " << leaves << " bad " << bad << " range " << first << "+"
+                        << count;
+                }
+            }
+            image_[bad * kBlock + 3] ^= 0x80;
+        }
+    }
+}
+
+} // namespace
+} // namespace ota
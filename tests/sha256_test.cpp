@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "sha256.h"
+#include "test_util.h"
+
+namespace ota {
+namespace {
+
+// 实现在进程内只选择一次; ctest 另以 OTA_SHA256_IMPL=scalar 运行本组测试,
+// 两种实现都须与下列参考值一致
+
+std::string hex_of(const std::string& msg) { return to_hex(Sha256::hash(msg.data(), msg.size())); }
+
+TEST(Sha256Test, FipsVectors) {
+    EXPECT_EQ(hex_of(""), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    EXPECT_EQ(hex_of("abc"), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    EXPECT_EQ(hex_of("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"),
+              "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+    EXPECT_EQ(hex_of("abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopq"
+                     "klmnopqrlmnopqrsmnopqrstnopqrstu"),
+              "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1");
+
+    // 一百万个 'a', 分 1000 次写入
+    const std::string thousand(1000, 'a');
+    Sha256 sha;
+    for (int i = 0; i < 1000; ++i) sha.update(thousand.data(), thousand.size());
+    EXPECT_EQ(to_hex(sha.finish()),
+              "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+}
+
+TEST(Sha256Test, PaddingBoundaries) {
+    // 55 字节以内填充放在同一块; 56 字节起长度字段落到下一块
+    const struct {
+        size_t len;
+        const char* hex;
+    } cases[] = {
+        {0, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+        {55, "9f4390f8d30c2dd92ec9f095b65e2b9ae9b0a925a5258e241c9f1e910f734318"},
+        {56, "b35439a4ac6f0948b6d6f9e3c6af0f5f590ce20f1bde7090ef7970686ec6738a"},
+        {63, "7d3e74a05d7db15bce4ad9ec0658ea98e3f06eeecf16b4c6fff2da457ddc2f34"},
+        {64, "ffe054fe7ae0cb6dc65c3af9b61d5209f439851db43d0ba5997337df154668eb"},
+        {65, "635361c48bb9eab14198e76ea8ab7f1a41685d6ad62aa9146d301d4f17eb0ae0"},
+    };
+    for (const auto& c : cases) {
+        EXPECT_EQ(hex_of(std::string(c.len, 'a')), c.hex) << "length " << c.len;
+    }
+}
+
+TEST(Sha256Test, MatchesReferenceForAllLengths) {
+    // 参考值: 依次对 random_bytes(n, n) (n = 0..1024) 求摘要, 再对全部摘要求摘要,
+    // 由另一实现 (Python hashlib) 计算
+    Sha256 chain;
+    for (size_t n = 0; n <= 1024; ++n) {
+        const std::vector<uint8_t> data = test::random_bytes(n, n);
+        const Digest d = Sha256::hash(data.data(), data.size());
+        chain.update(d.data(), d.size());
+    }
+    EXPECT_EQ(to_hex(chain.finish()),
+              "ff2407a3289d02033f32544b302e1f270fe25cf3a5dd7f83769f64a47969fca8");
+}
+
+TEST(Sha256Test, IncrementalUpdatesMatchOneShot) {
+    const std::vector<uint8_t> data = test::random_bytes(1000, 7);
+    const Digest expected = Sha256::hash(data.data(), data.size());
+
+    // 固定步长, 覆盖缓冲区半满后跨块的各种情形
+    Sha256 sha;
+    for (size_t step = 1; step <= 130; ++step) {
+        for (size_t off = 0; off < data.size(); off += step) {
+            sha.update(data.data() + off, std::min(step, data.size() - off));
+            sha.update(data.data(), 0);
+        }
+        EXPECT_EQ(sha.finish(), expected) << "step " << step;  // finish 后自动 reset
+    }
+
+    // 两段任意切分
+    const size_t n = 200;
+    const Digest prefix = Sha256::hash(data.data(), n);
+    for (size_t cut = 0; cut <= n; ++cut) {
+        sha.update(data.data(), cut);
+        sha.update(data.data() + cut, n - cut);
+        EXPECT_EQ(sha.finish(), prefix) << "cut " << cut;
+    }
+}
+
+TEST(Sha256Test, HonoursImplementationOverride) {
+    const char* force = std::getenv("OTA_SHA256_IMPL");
+    if (force && std::strcmp(force, "scalar") == 0) {
+        EXPECT_STREQ(Sha256::impl_name(), "scalar");
+    } else {
+        RecordProperty("implementation", Sha256::impl_name());
+    }
+}
+
+} // namespace
+} // namespace ota
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <stdlib.h>
+
+namespace ota {
+namespace test {
+
+// 测试用临时目录, 析构时连同内容一起删除
+class TempDir {
+public:
+    TempDir() {
+        char tmpl[] = "/tmp/ota_test.XXXXXX";
+        if (!::mkdtemp(tmpl)) throw std::runtime_error("cannot create temp dir");
+        path_ = tmpl;
+    }
+    ~TempDir() { std::system(("rm -rf '" + path_ + "'").c_str()); }
+
+    TempDir(const TempDir&) = delete;
+    TempDir& operator=(const TempDir&) = delete;
+
+    std::string file(const std::string& name) const { return path_ + "/" + name; }
+
+private:
+    std::string path_;
+};
+
+// 固定种子的伪随机数据 (xorshift64), 各次运行结果一致
+inline std::vector<uint8_t> random_bytes(size_t n, uint64_t seed) {
+    std::vector<uint8_t> out(n);
+    uint64_t x = seed * 0x9e3779b97f4a7c15ull + 1;
+    for (uint8_t& b : out) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        b = uint8_t(x >> 24);
+    }
+    return out;
+}
+
+inline void write_file(const std::string& path, const std::vector<uint8_t>& data) {
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    f.write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size()));
+    if (!f) throw std::runtime_error("cannot write " + path);
+}
+
+inline std::vector<uint8_t> read_file(const std::string& path) {
+    std::ifstream f(path, std::ios::binary);
+    if (!f) throw std::runtime_error("cannot read " + path);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+}
+
+} // namespace test
+} // namespace ota